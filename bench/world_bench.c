@@ -0,0 +1,207 @@
+// Headless timing of the hot paths that walk section storage: remeshing every
+// chunk in the render distance, block raycasts and player collision. make
+// bench builds it once per section layout; the checksums must match between
+// the two, only the times and cache misses may differ. Misses are L1 data
+// cache read misses from perf_event_open, where the kernel and hardware
+// offer that counter; virtual machines often do not.
+#define _GNU_SOURCE
+#include "mc.h"
+#include "world.h"
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define R 12 // render distance; one more chunk is loaded as the meshing halo
+#define RAYS 200000
+#define COLLISIONS 200000
+#define RUNS 5
+
+static Mc mc;
+static int miss_fd = -1;
+
+static void miss_counter_open(void)
+{
+#ifdef __linux__
+  struct perf_event_attr attr = {0};
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HW_CACHE;
+  attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  miss_fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+}
+
+// Misses so far, or -1 without a counter
+static double misses(void)
+{
+  long long count = 0;
+#ifdef __linux__
+  if (miss_fd >= 0 && read(miss_fd, &count, sizeof(count)) == sizeof(count))
+  {
+    return (double)count;
+  }
+#endif
+  return -1.0;
+}
+
+static u32 lcg(u32 *state)
+{
+  *state = *state * 1664525u + 1013904223u;
+  return *state >> 8;
+}
+
+// Uniform in [lo, hi)
+static float lcg_float(u32 *state, float lo, float hi)
+{
+  return lo + (hi - lo) * (float)lcg(state) / (float)(1u << 24);
+}
+
+static double seconds_since(Uint64 start)
+{
+  return (double)(SDL_GetPerformanceCounter() - start) /
+         (double)SDL_GetPerformanceFrequency();
+}
+
+static int compare_double(const void *a, const void *b)
+{
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static double median(double *runs)
+{
+  qsort(runs, RUNS, sizeof(double), compare_double);
+  return runs[RUNS / 2];
+}
+
+static long remesh_all(void)
+{
+  arena_reset(&mc.frame_arena); // as at the start of a frame
+  for (int i = 0; i < mc.chunks.cap; i++)
+  {
+    Chunk *chunk = mc.chunks.slots[i];
+    if (chunk)
+    {
+      chunk->mesh.dirty = true;
+      mesh_queue_push(&mc, chunk->cx, chunk->cz);
+    }
+  }
+  rebuild_faces(&mc, 0.0f);
+  long faces = 0;
+  for (int i = 0; i < mc.chunks.cap; i++)
+  {
+    if (mc.chunks.slots[i])
+    {
+      faces += mc.chunks.slots[i]->mesh.face_count;
+    }
+  }
+  return faces;
+}
+
+static long raycasts(void)
+{
+  u32 seed = 1;
+  long sum = 0;
+  for (int i = 0; i < RAYS; i++)
+  {
+    float span = (float)(R * CHUNK_SIZE);
+    v3f origin = {lcg_float(&seed, -span, span), -lcg_float(&seed, 0.0f, 40.0f),
+                  lcg_float(&seed, -span, span)};
+    v3f dir = {lcg_float(&seed, -1.0f, 1.0f), lcg_float(&seed, -1.0f, 1.0f),
+               lcg_float(&seed, -1.0f, 1.0f)};
+    int hx, hy, hz;
+    v3f normal;
+    if (raycast_block(&mc, origin, dir, 8.0f, &hx, &hy, &hz, &normal))
+    {
+      sum += hx + hy * 31 + hz * 17;
+    }
+  }
+  return sum;
+}
+
+static long collisions(void)
+{
+  u32 seed = 2;
+  long grounded = 0;
+  for (int i = 0; i < COLLISIONS; i++)
+  {
+    float span = (float)(R * CHUNK_SIZE);
+    mc.camera.pos = (v3f){lcg_float(&seed, -span, span), -lcg_float(&seed, 0.0f, 40.0f),
+                          lcg_float(&seed, -span, span)};
+    mc.velocity = (v3f){0};
+    resolve_collisions(&mc);
+    grounded += mc.grounded;
+  }
+  mc.camera.pos = (v3f){0};
+  return grounded;
+}
+
+// Times fn RUNS times; the median time in *seconds, misses per call in *miss
+#define MEASURE(fn, result, calls, seconds, miss)                              \
+  do                                                                           \
+  {                                                                            \
+    double times_[RUNS], misses_[RUNS];                                        \
+    for (int run_ = 0; run_ < RUNS; run_++)                                    \
+    {                                                                          \
+      double m0_ = misses();                                                   \
+      Uint64 start_ = SDL_GetPerformanceCounter();                             \
+      result = fn();                                                           \
+      times_[run_] = seconds_since(start_);                                    \
+      misses_[run_] = (m0_ < 0.0) ? -1.0 : (misses() - m0_) / (calls);         \
+    }                                                                          \
+    seconds = median(times_);                                                  \
+    miss = median(misses_);                                                    \
+  } while (0)
+
+static void print_misses(const char *what, double miss)
+{
+  if (miss < 0.0)
+    printf(" %s n/a", what);
+  else
+    printf(" %s %.2f", what, miss);
+}
+
+int main(void)
+{
+  mc.y_min = 0;
+  mc.y_max = 31;
+  mc.render_distance_chunks = R;
+  mc.load_distance_chunks = R + 1;
+  mc.lod_distance_chunks[0] = 4;
+  mc.lod_distance_chunks[1] = 8;
+  do
+  {
+    world_stream(&mc);
+  } while (mc.stream_pending);
+  miss_counter_open();
+
+  long faces, hits, grounded;
+  double mesh_s, ray_s, collide_s, mesh_miss, ray_miss, collide_miss;
+  MEASURE(remesh_all, faces, 1.0, mesh_s, mesh_miss);
+  MEASURE(raycasts, hits, RAYS, ray_s, ray_miss);
+  MEASURE(collisions, grounded, COLLISIONS, collide_s, collide_miss);
+
+#ifdef SECTION_BRICKS
+  const char *layout = "bricks";
+#else
+  const char *layout = "y-major";
+#endif
+  printf("bench %s: remesh %d chunks %.2f ms (%ld faces), raycast %.1f ns (%ld), "
+         "collide %.1f ns (%ld)\n",
+         layout, (2 * R + 1) * (2 * R + 1), mesh_s * 1e3, faces, ray_s * 1e9 / RAYS,
+         hits, collide_s * 1e9 / COLLISIONS, grounded);
+  printf("bench %s: L1d read misses:", layout);
+  print_misses("remesh", mesh_miss);
+  print_misses("per raycast", ray_miss);
+  print_misses("per collide", collide_miss);
+  printf("\n");
+  world_free(&mc);
+  return 0;
+}
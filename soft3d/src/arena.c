@@ -0,0 +1,71 @@
+#include "arena.h"
+#include <stdlib.h>
+
+#define ARENA_MIN_BLOCK (64 * 1024)
+#define ARENA_ALIGN 16
+
+static ArenaBlock *block_new(size_t cap, ArenaBlock *next) {
+  ArenaBlock *block = malloc(sizeof(ArenaBlock) + cap);
+  if (!block) {
+    return NULL;
+  }
+  block->next = next;
+  block->cap = cap;
+  block->used = 0;
+  return block;
+}
+
+void *arena_alloc(Arena *arena, size_t size) {
+  size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+  ArenaBlock *block = arena->head;
+  if (!block || block->cap - block->used < size) {
+    size_t cap = block ? block->cap * 2 : ARENA_MIN_BLOCK;
+    while (cap < size) {
+      cap *= 2;
+    }
+    block = block_new(cap, arena->head);
+    if (!block) {
+      return NULL;
+    }
+    arena->head = block;
+  }
+  void *p = block->data + block->used;
+  block->used += size;
+  return p;
+}
+
+size_t arena_used(const Arena *arena) {
+  size_t used = 0;
+  for (const ArenaBlock *b = arena->head; b; b = b->next) {
+    used += b->used;
+  }
+  return used;
+}
+
+void arena_reset(Arena *arena) {
+  size_t used = arena_used(arena);
+  if (used > arena->peak) {
+    arena->peak = used;
+  }
+  if (arena->head && arena->head->next) {
+    // Spilled last frame: replace the chain with one block that fits it
+    size_t cap = ARENA_MIN_BLOCK;
+    while (cap < arena->peak) {
+      cap *= 2;
+    }
+    arena_free(arena);
+    arena->head = block_new(cap, NULL);
+    return;
+  }
+  if (arena->head) {
+    arena->head->used = 0;
+  }
+}
+
+void arena_free(Arena *arena) {
+  while (arena->head) {
+    ArenaBlock *next = arena->head->next;
+    free(arena->head);
+    arena->head = next;
+  }
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stddef.h>
+
+// Linear allocator for per-frame scratch memory. Allocations live until the
+// next arena_reset; a frame that overflows the arena spills into extra
+// blocks, and the reset folds them into one block big enough for next time.
+typedef struct ArenaBlock {
+  struct ArenaBlock *next;
+  size_t cap;
+  size_t used;
+  _Alignas(16) unsigned char data[];
+} ArenaBlock;
+
+typedef struct {
+  ArenaBlock *head; // block being allocated from; older blocks follow
+  size_t peak;      // bytes used by the largest frame so far
+} Arena;
+
+void *arena_alloc(Arena *arena, size_t size);
+void arena_reset(Arena *arena);
+void arena_free(Arena *arena);
+size_t arena_used(const Arena *arena);
+
+#define ARENA_ALLOC(arena, type, count)                                        \
+  ((type *)arena_alloc((arena), (size_t)(count) * sizeof(type)))
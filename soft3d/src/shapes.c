@@ -130,11 +130,11 @@ static inline u32 blend_argb(u32 src, u32 dst, u8 alpha) {
   return 0xFF000000u | ((u32)out_r << 16) | ((u32)out_g << 8) | (u32)out_b;
 }
 
-static void draw_textured_triangle_internal(u32 *buffer, float *depth, int w,
-                                            int h, Texture *tex, VertexPC v0,
-                                            VertexPC v1, VertexPC v2,
-                                            bool force_opaque,
-                                            bool write_depth) {
+static int draw_textured_triangle_internal(u32 *buffer, float *depth, int w,
+                                           int h, Texture *tex, VertexPC v0,
+                                           VertexPC v1, VertexPC v2,
+                                           bool force_opaque,
+                                           bool write_depth) {
   // Bounding box
   int min_x = fminf(fminf(v0.pos.x, v1.pos.x), v2.pos.x);
   int max_x = fmaxf(fmaxf(v0.pos.x, v1.pos.x), v2.pos.x);
@@ -142,7 +142,7 @@ static void draw_textured_triangle_internal(u32 *buffer, float *depth, int w,
   int max_y = fmaxf(fmaxf(v0.pos.y, v1.pos.y), v2.pos.y);
 
   if (max_x < 0 || max_y < 0 || min_x >= w || min_y >= h) {
-    return;
+    return 0;
   }
 
   if (min_x < 0)
@@ -156,9 +156,10 @@ static void draw_textured_triangle_internal(u32 *buffer, float *depth, int w,
 
   float area = edge_func(v0.pos, v1.pos, (float)v2.pos.x, (float)v2.pos.y);
   if (area == 0.0f) {
-    return;
+    return 0;
   }
   float inv_area = 1.0f / area;
+  int shaded = 0;
 
   for (int y = min_y; y <= max_y; y++) {
     for (int x = min_x; x <= max_x; x++) {
@@ -172,6 +173,13 @@ static void draw_textured_triangle_internal(u32 *buffer, float *depth, int w,
         continue;
       }
 
+      // Depth test first so occluded pixels never pay for texturing
+      float depth_interp = w0 * v0.depth + w1 * v1.depth + w2 * v2.depth;
+      int idx = y * w + x;
+      if (depth_interp >= depth[idx]) {
+        continue;
+      }
+
       float inv_w_interp = w0 * v0.inv_w + w1 * v1.inv_w + w2 * v2.inv_w;
       if (inv_w_interp == 0.0f) {
         continue;
@@ -200,12 +208,6 @@ static void draw_textured_triangle_internal(u32 *buffer, float *depth, int w,
       if (alpha == 0)
         continue;
 
-      float depth_interp = w0 * v0.depth + w1 * v1.depth + w2 * v2.depth;
-      int idx = y * w + x;
-      if (depth_interp >= depth[idx]) {
-        continue;
-      }
-
       if (alpha < 255 && !force_opaque) {
         u32 dst = buffer[idx];
         buffer[idx] = blend_argb(sample, dst, alpha);
@@ -216,21 +218,23 @@ static void draw_textured_triangle_internal(u32 *buffer, float *depth, int w,
       if (write_depth) {
         depth[idx] = depth_interp;
       }
+      shaded++;
     }
   }
+  return shaded;
 }
 
-void draw_textured_triangle(u32 *buffer, float *depth, int w, int h, Texture *tex,
-                            VertexPC v0, VertexPC v1, VertexPC v2) {
-  draw_textured_triangle_internal(buffer, depth, w, h, tex, v0, v1, v2, true,
-                                  true);
+int draw_textured_triangle(u32 *buffer, float *depth, int w, int h, Texture *tex,
+                           VertexPC v0, VertexPC v1, VertexPC v2) {
+  return draw_textured_triangle_internal(buffer, depth, w, h, tex, v0, v1, v2,
+                                         true, true);
 }
 
-void draw_textured_triangle_alpha(u32 *buffer, float *depth, int w, int h,
-                                  Texture *tex, VertexPC v0, VertexPC v1,
-                                  VertexPC v2, bool write_depth) {
-  draw_textured_triangle_internal(buffer, depth, w, h, tex, v0, v1, v2, false,
-                                  write_depth);
+int draw_textured_triangle_alpha(u32 *buffer, float *depth, int w, int h,
+                                 Texture *tex, VertexPC v0, VertexPC v1,
+                                 VertexPC v2, bool write_depth) {
+  return draw_textured_triangle_internal(buffer, depth, w, h, tex, v0, v1, v2,
+                                         false, write_depth);
 }
 
 void draw_cirlcei(u32 *buffer, int w, v2i pos, int r, u32 color) {
@@ -0,0 +1,35 @@
+#include "blocks.h"
+
+const BlockInfo block_info[BLOCK_COUNT] = {
+    // Never drawn, so its texture slots are unused
+    [BLOCK_AIR] = {"NONE", BLOCK_EMPTY, BLOCK_ALPHA_NONE, false, {0, 0, 0}},
+    [BLOCK_GRASS] = {"GRASS", BLOCK_OPAQUE, BLOCK_ALPHA_NONE, true,
+                     {TEX_GRASS_TOP, TEX_GRASS_SIDE, TEX_DIRT}},
+    [BLOCK_DIRT] = {"DIRT", BLOCK_OPAQUE, BLOCK_ALPHA_NONE, true,
+                    {TEX_DIRT, TEX_DIRT, TEX_DIRT}},
+    [BLOCK_STONE] = {"STONE", BLOCK_OPAQUE, BLOCK_ALPHA_NONE, true,
+                     {TEX_STONE, TEX_STONE, TEX_STONE}},
+    [BLOCK_OAK_LOG] = {"OAK LOG", BLOCK_OPAQUE, BLOCK_ALPHA_NONE, true,
+                       {TEX_OAK_LOG_TOP, TEX_OAK_LOG_SIDE, TEX_OAK_LOG_TOP}},
+    [BLOCK_OAK_PLANKS] = {"OAK PLANKS", BLOCK_OPAQUE, BLOCK_ALPHA_NONE, true,
+                          {TEX_OAK_PLANKS, TEX_OAK_PLANKS, TEX_OAK_PLANKS}},
+    [BLOCK_COBBLESTONE] = {"COBBLESTONE", BLOCK_OPAQUE, BLOCK_ALPHA_NONE, true,
+                           {TEX_COBBLESTONE, TEX_COBBLESTONE, TEX_COBBLESTONE}},
+    [BLOCK_LEAVES] = {"LEAVES", BLOCK_TRANSLUCENT, BLOCK_ALPHA_BLEND, true,
+                      {TEX_LEAVES, TEX_LEAVES, TEX_LEAVES}},
+    [BLOCK_GLASS] = {"GLASS", BLOCK_TRANSLUCENT, BLOCK_ALPHA_BLEND, true,
+                     {TEX_GLASS, TEX_GLASS, TEX_GLASS}},
+};
+
+const char *const block_tex_paths[TEX_COUNT] = {
+    [TEX_DIRT] = "assets/dirt.png",
+    [TEX_STONE] = "assets/stone.png",
+    [TEX_GRASS_SIDE] = "assets/grass_side.png",
+    [TEX_GRASS_TOP] = "assets/grass_top.png",
+    [TEX_OAK_LOG_SIDE] = "assets/oak_log_side.png",
+    [TEX_OAK_LOG_TOP] = "assets/oak_log_top.png",
+    [TEX_OAK_PLANKS] = "assets/oak_planks.png",
+    [TEX_COBBLESTONE] = "assets/cobblestone.png",
+    [TEX_LEAVES] = "assets/leaves.png",
+    [TEX_GLASS] = "assets/glass.png",
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "mc.h"
+#include <stdbool.h>
+
+typedef enum
+{
+  BLOCK_EMPTY,       // nothing to draw, never hides a neighbour
+  BLOCK_TRANSLUCENT, // drawn, but faces behind it stay visible
+  BLOCK_OPAQUE,      // hides every face it touches
+} BlockOpacity;
+
+typedef enum
+{
+  BLOCK_ALPHA_NONE,  // written straight to the frame buffer
+  BLOCK_ALPHA_BLEND, // depth-sorted and alpha-blended after everything else
+} BlockAlpha;
+
+// Everything the mesher, renderer and physics need to know about a block
+// type, so adding one is a new row here and a texture in block_tex_paths.
+typedef struct
+{
+  const char *name;
+  u8 opacity; // BlockOpacity
+  u8 alpha;   // BlockAlpha
+  bool solid; // collides with the player and stops raycasts
+  u8 tex[3];  // BlockTex of the top, side and bottom faces
+} BlockInfo;
+
+enum
+{
+  BLOCK_FACE_TOP,
+  BLOCK_FACE_SIDE,
+  BLOCK_FACE_BOTTOM,
+};
+
+extern const BlockInfo block_info[BLOCK_COUNT];
+extern const char *const block_tex_paths[TEX_COUNT];
+
+static inline bool block_is_opaque(BlockType t)
+{
+  return block_info[t].opacity == BLOCK_OPAQUE;
+}
+
+static inline bool block_is_solid(BlockType t)
+{
+  return block_info[t].solid;
+}
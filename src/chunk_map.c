@@ -0,0 +1,110 @@
+#include "chunk_map.h"
+#include <stdlib.h>
+
+static u32 chunk_hash(int cx, int cz)
+{
+  u32 h = (u32)cx * 0x9E3779B1u ^ (u32)cz * 0x85EBCA77u;
+  h ^= h >> 15;
+  h *= 0x2C1B3C6Du;
+  h ^= h >> 12;
+  return h;
+}
+
+Chunk *chunk_map_get(const ChunkMap *map, int cx, int cz)
+{
+  if (map->count == 0)
+  {
+    return NULL;
+  }
+  u32 mask = (u32)map->cap - 1;
+  for (u32 i = chunk_hash(cx, cz) & mask;; i = (i + 1) & mask)
+  {
+    Chunk *c = map->slots[i];
+    if (!c)
+    {
+      return NULL;
+    }
+    if (c->cx == cx && c->cz == cz)
+    {
+      return c;
+    }
+  }
+}
+
+static void insert_slot(Chunk **slots, int cap, Chunk *chunk)
+{
+  u32 mask = (u32)cap - 1;
+  u32 i = chunk_hash(chunk->cx, chunk->cz) & mask;
+  while (slots[i])
+  {
+    i = (i + 1) & mask;
+  }
+  slots[i] = chunk;
+}
+
+// Keeps the load factor at or below one half.
+bool chunk_map_put(ChunkMap *map, Chunk *chunk)
+{
+  if ((map->count + 1) * 2 > map->cap)
+  {
+    int cap = map->cap ? map->cap * 2 : 64;
+    Chunk **slots = calloc((size_t)cap, sizeof(Chunk *));
+    if (!slots)
+    {
+      return false;
+    }
+    for (int i = 0; i < map->cap; i++)
+    {
+      if (map->slots[i])
+      {
+        insert_slot(slots, cap, map->slots[i]);
+      }
+    }
+    free(map->slots);
+    map->slots = slots;
+    map->cap = cap;
+  }
+  insert_slot(map->slots, map->cap, chunk);
+  map->count++;
+  return true;
+}
+
+// Backward-shift deletion keeps probe chains intact without tombstones.
+Chunk *chunk_map_remove(ChunkMap *map, int cx, int cz)
+{
+  if (map->count == 0)
+  {
+    return NULL;
+  }
+  u32 mask = (u32)map->cap - 1;
+  u32 i = chunk_hash(cx, cz) & mask;
+  while (map->slots[i] && (map->slots[i]->cx != cx || map->slots[i]->cz != cz))
+  {
+    i = (i + 1) & mask;
+  }
+  Chunk *removed = map->slots[i];
+  if (!removed)
+  {
+    return NULL;
+  }
+  map->slots[i] = NULL;
+  map->count--;
+  for (u32 j = (i + 1) & mask; map->slots[j]; j = (j + 1) & mask)
+  {
+    u32 home = chunk_hash(map->slots[j]->cx, map->slots[j]->cz) & mask;
+    // Move the entry back if its home slot is not in the cyclic range (i, j]
+    if (((j - home) & mask) >= ((j - i) & mask))
+    {
+      map->slots[i] = map->slots[j];
+      map->slots[j] = NULL;
+      i = j;
+    }
+  }
+  return removed;
+}
+
+void chunk_map_free(ChunkMap *map)
+{
+  free(map->slots);
+  *map = (ChunkMap){0};
+}
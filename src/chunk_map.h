@@ -0,0 +1,9 @@
+#pragma once
+
+#include "mc.h"
+#include <stdbool.h>
+
+Chunk *chunk_map_get(const ChunkMap *map, int cx, int cz);
+bool chunk_map_put(ChunkMap *map, Chunk *chunk);
+Chunk *chunk_map_remove(ChunkMap *map, int cx, int cz);
+void chunk_map_free(ChunkMap *map);
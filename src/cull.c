@@ -0,0 +1,156 @@
+#include "cull.h"
+#include "math.h"
+#include "world.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ENTRY_NONE 6 // the camera section was not entered through a face
+
+typedef struct
+{
+  int cx;
+  int sy;
+  int cz;
+  u8 entry; // FaceDir the search came in through
+  u8 dirs;  // directions travelled so far, never reversed
+} CullNode;
+
+static inline int floor_div(int a, int b)
+{
+  return (a >= 0) ? a / b : -((-a + b - 1) / b);
+}
+
+// Sections searched: the render square, one section above and below the
+// world so the search can go over the terrain and under overhangs.
+static void cull_bounds(const Mc *mc, int *sec_lo, int *sec_hi)
+{
+  *sec_lo = floor_div(mc->y_min, SECTION_SIZE) - 1;
+  *sec_hi = floor_div(mc->y_max, SECTION_SIZE) + 1;
+}
+
+int cull_section_capacity(const Mc *mc)
+{
+  int sec_lo, sec_hi;
+  cull_bounds(mc, &sec_lo, &sec_hi);
+  int side = 2 * mc->render_distance_chunks + 1;
+  return side * side * (sec_hi - sec_lo + 1);
+}
+
+static bool section_in_frustum(const mat4 *mvp, int cx, int sy, int cz)
+{
+  float x0 = (float)(cx * CHUNK_SIZE);
+  float z0 = (float)(cz * CHUNK_SIZE);
+  float y1 = -(float)(sy * SECTION_SIZE);
+  float y0 = y1 - (float)SECTION_SIZE;
+  int and_mask = 0x3F;
+  for (int i = 0; i < 8; i++)
+  {
+    v4f p = {(i & 1) ? x0 + (float)CHUNK_SIZE : x0, (i & 2) ? y1 : y0,
+             (i & 4) ? z0 + (float)CHUNK_SIZE : z0, 1.0f};
+    v4f c = mat4_mul_v4(*mvp, p);
+    int mask = 0;
+    if (c.x < -c.w)
+      mask |= 1;
+    if (c.x > c.w)
+      mask |= 2;
+    if (c.y < -c.w)
+      mask |= 4;
+    if (c.y > c.w)
+      mask |= 8;
+    if (c.z > c.w)
+      mask |= 32;
+    and_mask &= mask;
+  }
+  return and_mask == 0;
+}
+
+// Breadth-first search from the camera section through faces that the
+// section meshes report as connected. Sections come out roughly nearest
+// first. reaches_edge tells whether anything on the render border was seen,
+// i.e. whether the far terrain can be visible at all.
+int cull_visible_sections(Mc *mc, const mat4 *mvp, Arena *scratch,
+                          VisibleSection *out, bool *reaches_edge)
+{
+  static const int step_x[6] = {0, 0, 0, 0, -1, 1};
+  static const int step_y[6] = {-1, 1, 0, 0, 0, 0};
+  static const int step_z[6] = {0, 0, 1, -1, 0, 0};
+
+  *reaches_edge = false;
+  int r = mc->render_distance_chunks;
+  int side = 2 * r + 1;
+  int sec_lo, sec_hi;
+  cull_bounds(mc, &sec_lo, &sec_hi);
+  int capacity = cull_section_capacity(mc);
+  CullNode *queue = ARENA_ALLOC(scratch, CullNode, capacity);
+  u8 *visited = ARENA_ALLOC(scratch, u8, capacity);
+  if (!queue || !visited)
+  {
+    return 0;
+  }
+  memset(visited, 0, (size_t)capacity);
+#define VISITED(cx, sy, cz)                                                    \
+  visited[(((sy) - sec_lo) * side + ((cz) - mc->chunk_cz + r)) * side +        \
+          ((cx) - mc->chunk_cx + r)]
+
+  int cam_sy = floor_div((int)floorf(-mc->camera.pos.y), SECTION_SIZE);
+  if (cam_sy < sec_lo)
+    cam_sy = sec_lo;
+  if (cam_sy > sec_hi)
+    cam_sy = sec_hi;
+
+  int head = 0, tail = 0, count = 0;
+  queue[tail++] = (CullNode){mc->chunk_cx, cam_sy, mc->chunk_cz, ENTRY_NONE, 0};
+  VISITED(mc->chunk_cx, cam_sy, mc->chunk_cz) = 1;
+  while (head < tail)
+  {
+    CullNode node = queue[head++];
+    // Keeps the mesh for the budget and brings an evicted one back
+    chunk_mesh_seen(mc, node.cx, node.cz);
+    const SectionMesh *section = section_mesh_get(mc, node.cx, node.sy, node.cz);
+    if (section && section->group_start[0] != section->group_start[MESH_GROUPS])
+    {
+      out[count++] = (VisibleSection){node.cx, node.sy, node.cz};
+    }
+    if (abs(node.cx - mc->chunk_cx) == r || abs(node.cz - mc->chunk_cz) == r)
+    {
+      *reaches_edge = true;
+    }
+
+    // Sections outside the meshed world are open air
+    u8 links = 0x3F;
+    if (mc->cave_culling && section && node.entry != ENTRY_NONE)
+    {
+      links = section->links[node.entry];
+    }
+    for (int dir = 0; dir < 6; dir++)
+    {
+      if (!(links & (1 << dir)))
+      {
+        continue;
+      }
+      // Going back towards the camera cannot reveal anything new
+      if (mc->cave_culling && (node.dirs & (1 << (dir ^ 1))))
+      {
+        continue;
+      }
+      int nx = node.cx + step_x[dir];
+      int ny = node.sy + step_y[dir];
+      int nz = node.cz + step_z[dir];
+      if (abs(nx - mc->chunk_cx) > r || abs(nz - mc->chunk_cz) > r ||
+          ny < sec_lo || ny > sec_hi || VISITED(nx, ny, nz))
+      {
+        continue;
+      }
+      VISITED(nx, ny, nz) = 1;
+      if (!section_in_frustum(mvp, nx, ny, nz))
+      {
+        continue;
+      }
+      queue[tail++] = (CullNode){nx, ny, nz, (u8)(dir ^ 1),
+                                 (u8)(node.dirs | (1 << dir))};
+    }
+  }
+#undef VISITED
+  return count;
+}
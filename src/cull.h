@@ -0,0 +1,15 @@
+#pragma once
+
+#include "mc.h"
+#include <stdbool.h>
+
+typedef struct
+{
+  int cx;
+  int sy;
+  int cz;
+} VisibleSection;
+
+int cull_section_capacity(const Mc *mc);
+int cull_visible_sections(Mc *mc, const mat4 *mvp, Arena *scratch,
+                          VisibleSection *out, bool *reaches_edge);
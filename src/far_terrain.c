@@ -0,0 +1,362 @@
+#include "far_terrain.h"
+#include "blocks.h"
+#include "render.h"
+#include "world.h"
+#include "chunk_map.h"
+#include "worldgen.h"
+#include <math.h>
+#include <stdlib.h>
+
+#define FAR_CELLS (CHUNK_SIZE / FAR_CELL)
+
+static u32 average_color(const Texture *tex)
+{
+  u32 r = 0, g = 0, b = 0, n = 0;
+  for (int i = 0; i < tex->w * tex->h; i++)
+  {
+    u32 p = tex->pixels[i];
+    if ((p >> 24) == 0)
+    {
+      continue;
+    }
+    r += (p >> 16) & 0xFF;
+    g += (p >> 8) & 0xFF;
+    b += p & 0xFF;
+    n++;
+  }
+  if (n == 0)
+  {
+    return 0xFF808080u;
+  }
+  return 0xFF000000u | ((r / n) << 16) | ((g / n) << 8) | (b / n);
+}
+
+bool far_terrain_init(Mc *mc)
+{
+  FarTerrain *far = &mc->far;
+  for (int t = BLOCK_AIR + 1; t < BLOCK_COUNT; t++)
+  {
+    far->colors[t].w = 1;
+    far->colors[t].h = 1;
+    far->colors[t].pixels = malloc(sizeof(u32));
+    if (!far->colors[t].pixels)
+    {
+      far_terrain_free(mc);
+      return false;
+    }
+    far->colors[t].pixels[0] = average_color(
+        &mc->block_tex[block_info[t].tex[BLOCK_FACE_TOP]]);
+  }
+
+  far->side = 2 * mc->far_distance_chunks + 1;
+  int count = far->side * far->side;
+  far->tiles = calloc((size_t)count, sizeof(FarTile));
+  if (!far->tiles)
+  {
+    far_terrain_free(mc);
+    return false;
+  }
+  for (int i = 0; i < count; i++)
+  {
+    far->tiles[i].dirty = true;
+  }
+  return true;
+}
+
+void far_terrain_free(Mc *mc)
+{
+  FarTerrain *far = &mc->far;
+  if (far->tiles)
+  {
+    for (int i = 0; i < far->side * far->side; i++)
+    {
+      free(far->tiles[i].faces);
+    }
+    free(far->tiles);
+    far->tiles = NULL;
+  }
+  for (int t = 0; t < BLOCK_COUNT; t++)
+  {
+    texture_destroy(&far->colors[t]);
+  }
+}
+
+static inline int floor_div(int a, int b)
+{
+  return (a >= 0) ? a / b : -((-a + b - 1) / b);
+}
+
+// Tiles live in a ring indexed by chunk coordinates modulo its side, so the
+// slot of a chunk column is fixed and a slot holding another column is stale.
+static FarTile *tile_slot(const Mc *mc, int cx, int cz)
+{
+  int side = mc->far.side;
+  int i = ((cz % side) + side) % side;
+  int j = ((cx % side) + side) % side;
+  return &mc->far.tiles[i * side + j];
+}
+
+static void mark_tile(Mc *mc, int cx, int cz)
+{
+  FarTile *tile = tile_slot(mc, cx, cz);
+  if (tile->cx == cx && tile->cz == cz)
+  {
+    tile->dirty = true;
+  }
+}
+
+// Marks stale every tile that samples a column of the block rectangle
+// x0..x1, z0..z1 (inclusive). Samples on a tile's low edges are shared with
+// the neighbouring tiles, so those are marked too.
+void far_terrain_mark(Mc *mc, int x0, int z0, int x1, int z1)
+{
+  if (!mc->far.tiles)
+  {
+    return;
+  }
+  for (int cz = floor_div(z0 - 1, CHUNK_SIZE); cz <= floor_div(z1, CHUNK_SIZE); cz++)
+  {
+    for (int cx = floor_div(x0 - 1, CHUNK_SIZE); cx <= floor_div(x1, CHUNK_SIZE);
+         cx++)
+    {
+      mark_tile(mc, cx, cz);
+    }
+  }
+}
+
+// Highest opaque block of a column (so canopies do not turn into spikes),
+// else its highest block, else the world floor; and the type of the highest
+// non-air block, BLOCK_AIR if the column is empty.
+// Both come from the chunk's heightmap, which outlives its blocks, so chunks
+// dropped for the budget are not reloaded. False if the chunk is not loaded,
+// so the column has to come from the terrain generator.
+static bool column_surface(Mc *mc, int x, int z, int *y, BlockType *type)
+{
+  int cx = floor_div(x, CHUNK_SIZE);
+  int cz = floor_div(z, CHUNK_SIZE);
+  Chunk *chunk = chunk_map_get(&mc->chunks, cx, cz);
+  if (!chunk)
+  {
+    chunk = chunk_map_get(&mc->parked, cx, cz);
+  }
+  if (!chunk || chunk->stage < CHUNK_STAGE_HEIGHTMAP)
+  {
+    return false;
+  }
+
+  int lx = x - cx * CHUNK_SIZE;
+  int lz = z - cz * CHUNK_SIZE;
+  *type = chunk_column_type(chunk, lx, lz);
+  *y = chunk_column_top(chunk, lx, lz, true);
+  if (*y == COLUMN_EMPTY)
+  {
+    *y = chunk_column_top(chunk, lx, lz, false);
+  }
+  if (*y == COLUMN_EMPTY)
+  {
+    *y = mc->y_max + 1;
+  }
+  return true;
+}
+
+// Nothing is drawn for cells without a colour, i.e. empty columns
+static void add_quad(FarTile *tile, Texture *tex, v3f p0, v3f p1, v3f p2,
+                     v3f p3)
+{
+  if (!tex)
+  {
+    return;
+  }
+  tile->faces[tile->face_count++] =
+      (Face){{{p0, {0.0f, 1.0f}}, {p1, {1.0f, 1.0f}}, {p2, {1.0f, 0.0f}}}, tex};
+  tile->faces[tile->face_count++] =
+      (Face){{{p0, {0.0f, 1.0f}}, {p2, {1.0f, 0.0f}}, {p3, {0.0f, 0.0f}}}, tex};
+}
+
+static void build_tile(Mc *mc, FarTile *tile, int cx, int cz)
+{
+  tile->cx = cx;
+  tile->cz = cz;
+  tile->dirty = false;
+  tile->face_count = 0;
+  for (int e = 0; e < 5; e++)
+  {
+    tile->skirt_start[e] = 0;
+  }
+  if (!tile->faces)
+  {
+    tile->faces = malloc(FAR_CELLS * (FAR_CELLS + 4) * 2 * sizeof(Face));
+    if (!tile->faces)
+    {
+      return;
+    }
+  }
+
+  // Generator heights of the cell corners, four at a time, for the ones in
+  // chunks that are not loaded; those are grass all over.
+  const int bx0 = cx * CHUNK_SIZE;
+  const int bz0 = cz * CHUNK_SIZE;
+  float noise[FAR_CELLS + 1][FAR_CELLS + 1];
+  worldgen_height_grid(bx0, bz0, FAR_CELLS + 1, FAR_CELLS + 1, FAR_CELL,
+                       &noise[0][0]);
+  float height[FAR_CELLS + 1][FAR_CELLS + 1];
+  Texture *color[FAR_CELLS][FAR_CELLS];
+  BlockType type;
+  int y;
+  for (int j = 0; j <= FAR_CELLS; j++)
+  {
+    for (int i = 0; i <= FAR_CELLS; i++)
+    {
+      if (!column_surface(mc, bx0 + i * FAR_CELL, bz0 + j * FAR_CELL, &y, &type))
+      {
+        y = worldgen_surface(noise[j][i]);
+      }
+      height[j][i] = -(float)y;
+    }
+  }
+  for (int j = 0; j < FAR_CELLS; j++)
+  {
+    for (int i = 0; i < FAR_CELLS; i++)
+    {
+      if (!column_surface(mc, bx0 + i * FAR_CELL + FAR_CELL / 2,
+                          bz0 + j * FAR_CELL + FAR_CELL / 2, &y, &type))
+      {
+        type = BLOCK_GRASS;
+      }
+      color[j][i] = (type == BLOCK_AIR) ? NULL : &mc->far.colors[type];
+    }
+  }
+
+  for (int j = 0; j < FAR_CELLS; j++)
+  {
+    for (int i = 0; i < FAR_CELLS; i++)
+    {
+      float x0 = (float)(bx0 + i * FAR_CELL);
+      float x1 = x0 + (float)FAR_CELL;
+      float z0 = (float)(bz0 + j * FAR_CELL);
+      float z1 = z0 + (float)FAR_CELL;
+      // Same winding as a block top face: (x0,z1) (x1,z1) (x1,z0) (x0,z0)
+      add_quad(tile, color[j][i], (v3f){x0, height[j + 1][i], z1},
+               (v3f){x1, height[j + 1][i + 1], z1},
+               (v3f){x1, height[j][i + 1], z0}, (v3f){x0, height[j][i], z0});
+    }
+  }
+
+  // Skirts along each edge hide cracks against the voxel meshes.
+  const float depth = (float)(FAR_CELL * 2);
+  const int n = FAR_CELLS;
+  const float xa = (float)bx0, xb = xa + (float)CHUNK_SIZE;
+  const float za = (float)bz0, zb = za + (float)CHUNK_SIZE;
+  tile->skirt_start[0] = tile->face_count;
+  for (int j = 0; j < n; j++)
+  {
+    float z0 = za + (float)(j * FAR_CELL), z1 = z0 + (float)FAR_CELL;
+    float y0 = fminf(height[j][0], height[j + 1][0]) - depth;
+    add_quad(tile, color[j][0], (v3f){xa, y0, z0}, (v3f){xa, y0, z1},
+             (v3f){xa, height[j + 1][0], z1}, (v3f){xa, height[j][0], z0});
+  }
+  tile->skirt_start[1] = tile->face_count;
+  for (int j = 0; j < n; j++)
+  {
+    float z0 = za + (float)(j * FAR_CELL), z1 = z0 + (float)FAR_CELL;
+    float y0 = fminf(height[j][n], height[j + 1][n]) - depth;
+    add_quad(tile, color[j][n - 1], (v3f){xb, y0, z1}, (v3f){xb, y0, z0},
+             (v3f){xb, height[j][n], z0}, (v3f){xb, height[j + 1][n], z1});
+  }
+  tile->skirt_start[2] = tile->face_count;
+  for (int i = 0; i < n; i++)
+  {
+    float x0 = xa + (float)(i * FAR_CELL), x1 = x0 + (float)FAR_CELL;
+    float y0 = fminf(height[0][i], height[0][i + 1]) - depth;
+    add_quad(tile, color[0][i], (v3f){x1, y0, za}, (v3f){x0, y0, za},
+             (v3f){x0, height[0][i], za}, (v3f){x1, height[0][i + 1], za});
+  }
+  tile->skirt_start[3] = tile->face_count;
+  for (int i = 0; i < n; i++)
+  {
+    float x0 = xa + (float)(i * FAR_CELL), x1 = x0 + (float)FAR_CELL;
+    float y0 = fminf(height[n][i], height[n][i + 1]) - depth;
+    add_quad(tile, color[n - 1][i], (v3f){x0, y0, zb}, (v3f){x1, y0, zb},
+             (v3f){x1, height[n][i + 1], zb}, (v3f){x0, height[n][i], zb});
+  }
+  tile->skirt_start[4] = tile->face_count;
+}
+
+// Tile of chunk column (cx, cz), or NULL if far_terrain_update has not
+// built one for it yet. A tile marked stale keeps its old faces until it is
+// rebuilt.
+FarTile *far_terrain_tile(Mc *mc, int cx, int cz)
+{
+  if (!mc->far.tiles)
+  {
+    return NULL;
+  }
+  FarTile *tile = tile_slot(mc, cx, cz);
+  return (tile->faces && tile->cx == cx && tile->cz == cz) ? tile : NULL;
+}
+
+// Builds the tile of (cx, cz) if it is missing or stale and the renderer
+// could draw it, i.e. unless a mesh covers the chunk. False once the budget
+// has run out.
+static bool update_tile(Mc *mc, int cx, int cz, Uint64 start, Uint64 budget)
+{
+  if (abs(cx - mc->chunk_cx) <= mc->render_distance_chunks &&
+      abs(cz - mc->chunk_cz) <= mc->render_distance_chunks)
+  {
+    const Chunk *chunk = chunk_map_get(&mc->chunks, cx, cz);
+    if (chunk && chunk->stage == CHUNK_STAGE_MESHED)
+    {
+      return true;
+    }
+  }
+  FarTile *tile = tile_slot(mc, cx, cz);
+  if (tile->faces && !tile->dirty && tile->cx == cx && tile->cz == cz)
+  {
+    return true;
+  }
+  if (budget > 0 && SDL_GetPerformanceCounter() - start >= budget)
+  {
+    return false;
+  }
+  build_tile(mc, tile, cx, cz);
+  return true;
+}
+
+// Builds missing and stale tiles in the far distance, ring by ring from the
+// camera chunk outwards. With budget_ms above zero it stops once that much
+// time has gone by and carries on from the nearest ring next call, so a
+// camera jump spreads the work over several frames instead of stalling one.
+void far_terrain_update(Mc *mc, float budget_ms)
+{
+  if (!mc->far.tiles)
+  {
+    return;
+  }
+  const Uint64 start = SDL_GetPerformanceCounter();
+  const Uint64 budget =
+      (Uint64)((double)budget_ms * 1e-3 * (double)SDL_GetPerformanceFrequency());
+  const int x = mc->chunk_cx, z = mc->chunk_cz;
+  if (!update_tile(mc, x, z, start, budget))
+  {
+    return;
+  }
+  for (int d = 1; d <= mc->far_distance_chunks; d++)
+  {
+    for (int i = -d; i <= d; i++)
+    {
+      if (!update_tile(mc, x + i, z - d, start, budget) ||
+          !update_tile(mc, x + i, z + d, start, budget))
+      {
+        return;
+      }
+    }
+    for (int i = -d + 1; i < d; i++)
+    {
+      if (!update_tile(mc, x - d, z + i, start, budget) ||
+          !update_tile(mc, x + d, z + i, start, budget))
+      {
+        return;
+      }
+    }
+  }
+}
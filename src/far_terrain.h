@@ -0,0 +1,10 @@
+#pragma once
+
+#include "mc.h"
+#include <stdbool.h>
+
+bool far_terrain_init(Mc *mc);
+void far_terrain_free(Mc *mc);
+void far_terrain_mark(Mc *mc, int x0, int z0, int x1, int z1);
+FarTile *far_terrain_tile(Mc *mc, int cx, int cz);
+void far_terrain_update(Mc *mc, float budget_ms);
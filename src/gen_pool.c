@@ -0,0 +1,179 @@
+#include "gen_pool.h"
+#include "worldgen.h"
+
+static void job_swap(GenJob *a, GenJob *b)
+{
+  GenJob t = *a;
+  *a = *b;
+  *b = t;
+}
+
+// Removes the most urgent job. The lock must be held.
+static Chunk *job_pop(GenPool *pool)
+{
+  GenJob *jobs = pool->jobs;
+  Chunk *chunk = jobs[0].chunk;
+  jobs[0] = jobs[--pool->job_count];
+  for (int i = 0;;)
+  {
+    int best = i;
+    int l = 2 * i + 1, r = 2 * i + 2;
+    if (l < pool->job_count && jobs[l].priority < jobs[best].priority)
+      best = l;
+    if (r < pool->job_count && jobs[r].priority < jobs[best].priority)
+      best = r;
+    if (best == i)
+    {
+      break;
+    }
+    job_swap(&jobs[i], &jobs[best]);
+    i = best;
+  }
+  return chunk;
+}
+
+static int gen_worker(void *data)
+{
+  GenPool *pool = data;
+  SDL_LockMutex(pool->lock);
+  for (;;)
+  {
+    while (!pool->quit && pool->job_count == 0)
+    {
+      SDL_CondWait(pool->work, pool->lock);
+    }
+    if (pool->quit)
+    {
+      break;
+    }
+    Chunk *chunk = job_pop(pool);
+    SDL_UnlockMutex(pool->lock);
+
+    // On failure the chunk comes back short of CHUNK_STAGE_HEIGHTMAP and
+    // the caller queues it again
+    worldgen_advance(chunk, CHUNK_STAGE_HEIGHTMAP);
+
+    SDL_LockMutex(pool->lock);
+    pool->done[pool->done_count++] = chunk;
+  }
+  SDL_UnlockMutex(pool->lock);
+  return 0;
+}
+
+// Starts one worker per spare core. Returns false if none could be started,
+// in which case the caller generates on its own thread.
+bool gen_pool_init(GenPool *pool)
+{
+  *pool = (GenPool){0};
+  pool->lock = SDL_CreateMutex();
+  pool->work = SDL_CreateCond();
+  if (!pool->lock || !pool->work)
+  {
+    gen_pool_free(pool);
+    return false;
+  }
+  int threads = SDL_GetCPUCount() - 1;
+  if (threads < 1)
+    threads = 1;
+  if (threads > GEN_MAX_THREADS)
+    threads = GEN_MAX_THREADS;
+  for (int i = 0; i < threads; i++)
+  {
+    SDL_Thread *thread = SDL_CreateThread(gen_worker, "worldgen", pool);
+    if (!thread)
+    {
+      break;
+    }
+    pool->threads[pool->thread_count++] = thread;
+  }
+  if (pool->thread_count == 0)
+  {
+    gen_pool_free(pool);
+    return false;
+  }
+  return true;
+}
+
+// Queues a chunk with its cx/cz set; the workers take the lowest priority
+// first. The caller must not touch it until gen_pool_collect or
+// gen_pool_reclaim hands it back, and keeps at most GEN_QUEUE_SIZE chunks
+// outstanding.
+bool gen_pool_submit(GenPool *pool, Chunk *chunk, float priority)
+{
+  if (pool->thread_count == 0)
+  {
+    return false;
+  }
+  SDL_LockMutex(pool->lock);
+  bool queued = pool->job_count < GEN_QUEUE_SIZE;
+  if (queued)
+  {
+    int i = pool->job_count++;
+    pool->jobs[i] = (GenJob){chunk, priority};
+    while (i > 0 && pool->jobs[i].priority < pool->jobs[(i - 1) / 2].priority)
+    {
+      job_swap(&pool->jobs[i], &pool->jobs[(i - 1) / 2]);
+      i = (i - 1) / 2;
+    }
+    SDL_CondSignal(pool->work);
+  }
+  SDL_UnlockMutex(pool->lock);
+  return queued;
+}
+
+// Takes back up to max chunks no worker has started on, so they can be
+// queued again with new priorities or dropped.
+int gen_pool_reclaim(GenPool *pool, Chunk **out, int max)
+{
+  if (pool->thread_count == 0)
+  {
+    return 0;
+  }
+  SDL_LockMutex(pool->lock);
+  int n = (pool->job_count < max) ? pool->job_count : max;
+  for (int i = 0; i < n; i++)
+  {
+    out[i] = pool->jobs[--pool->job_count].chunk;
+  }
+  SDL_UnlockMutex(pool->lock);
+  return n;
+}
+
+// Takes up to max finished chunks, including any a worker had to leave short
+// of CHUNK_STAGE_HEIGHTMAP.
+int gen_pool_collect(GenPool *pool, Chunk **out, int max)
+{
+  if (pool->thread_count == 0)
+  {
+    return 0;
+  }
+  SDL_LockMutex(pool->lock);
+  int n = (pool->done_count < max) ? pool->done_count : max;
+  pool->done_count -= n;
+  for (int i = 0; i < n; i++)
+  {
+    out[i] = pool->done[pool->done_count + i];
+  }
+  SDL_UnlockMutex(pool->lock);
+  return n;
+}
+
+// Stops the workers once they finish the chunk in hand. Chunks still queued
+// or finished stay with whoever submitted them.
+void gen_pool_free(GenPool *pool)
+{
+  if (pool->lock)
+  {
+    SDL_LockMutex(pool->lock);
+    pool->quit = true;
+    SDL_CondBroadcast(pool->work);
+    SDL_UnlockMutex(pool->lock);
+  }
+  for (int i = 0; i < pool->thread_count; i++)
+  {
+    SDL_WaitThread(pool->threads[i], NULL);
+  }
+  SDL_DestroyCond(pool->work);
+  SDL_DestroyMutex(pool->lock);
+  *pool = (GenPool){0};
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include "mc.h"
+#include <stdbool.h>
+
+bool gen_pool_init(GenPool *pool);
+bool gen_pool_submit(GenPool *pool, Chunk *chunk, float priority);
+int gen_pool_reclaim(GenPool *pool, Chunk **out, int max);
+int gen_pool_collect(GenPool *pool, Chunk **out, int max);
+void gen_pool_free(GenPool *pool);
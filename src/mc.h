@@ -1,8 +1,11 @@
 #pragma once
 
+#include "arena.h"
 #include "types.h"
 #include <SDL2/SDL.h>
+#include <limits.h>
 #include <stdbool.h>
+#include <stdio.h>
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
@@ -17,6 +20,10 @@
 #define JUMP_VELOCITY 5.0f
 #define WALK_SPEED 4.0f
 #define CHUNK_SIZE 16
+#define SECTION_SIZE 16 // vertical extent of a mesh section
+#define LOD_LEVELS 3 // 0 = full detail, n = 2^n downsampled cells
+#define COLUMN_EMPTY INT_MAX // column top of a column with no blocks
+#define MESH_BUDGET_MS 4.0f // meshing time per frame unless unlimited
 
 typedef struct
 {
@@ -54,35 +61,349 @@ typedef enum
   BLOCK_COBBLESTONE,
   BLOCK_LEAVES,
   BLOCK_GLASS,
+  BLOCK_COUNT,
 } BlockType;
 
+// Block texture slots, see block_info for which faces use them
+typedef enum
+{
+  TEX_DIRT,
+  TEX_STONE,
+  TEX_GRASS_SIDE,
+  TEX_GRASS_TOP,
+  TEX_OAK_LOG_SIDE,
+  TEX_OAK_LOG_TOP,
+  TEX_OAK_PLANKS,
+  TEX_COBBLESTONE,
+  TEX_LEAVES,
+  TEX_GLASS,
+  TEX_COUNT,
+} BlockTex;
+
 typedef struct
 {
   Vertex3D v[3];
   Texture *tex;
 } Face;
 
+typedef enum
+{
+  FACE_TOP,
+  FACE_BOTTOM,
+  FACE_FRONT, // +z
+  FACE_BACK,  // -z
+  FACE_LEFT,  // -x
+  FACE_RIGHT, // +x
+} FaceDir;
+
+#define MESH_GROUPS 7 // opaque faces by FaceDir, then all transparent faces
+#define MESH_GROUP_TRANSPARENT 6
+
+typedef struct
+{
+  int group_start[MESH_GROUPS + 1];
+  u8 links[6]; // per FaceDir, faces reachable through non-opaque blocks
+} SectionMesh;
+
+#define MESH_PAGE_FACES 64 // faces per mesh pool page
+#define MESH_SLAB_PAGES 64 // pages the pool reserves from malloc at once
+
+typedef union MeshPage
+{
+  union MeshPage *next; // free list link while the page is unused
+  Face faces[MESH_PAGE_FACES];
+} MeshPage;
+
+typedef struct
+{
+  MeshPage *free_pages;
+  int pages_used;
+  MeshPage pages[MESH_SLAB_PAGES];
+} MeshSlab;
+
+typedef struct
+{
+  MeshSlab **slabs; // by address, so a freed page finds its slab
+  int slab_count;
+  int slab_cap;
+  MeshSlab *current; // slab new pages are taken from
+  size_t byte_limit; // no slab is added past this many bytes, 0 for no cap
+  size_t pages_reserved;
+  size_t pages_used;
+  size_t faces_used;
+} MeshPool;
+
+typedef struct
+{
+  MeshPage **pages; // faces section by section, each split into its groups
+  int page_count;
+  int page_cap;
+  int face_count;
+  SectionMesh *sections;
+  int section_min;
+  int section_count;
+  int lod;
+  u8 skirt_mask; // chunk borders (-x, +x, -z, +z) that carry crack skirts
+  bool dirty;
+  bool queued;       // in mc->mesh_queue
+  bool evicted;      // faces dropped for the mesh budget until seen again
+  Uint32 seen_ticks; // last time the cull search reached the chunk
+} ChunkMesh;
+
+typedef struct
+{
+  // SECTION_SIZE x CHUNK_SIZE x CHUNK_SIZE, y-major; NULL if all air. Shared
+  // with snapshots, so writers go through chunk_section_alloc.
+  BlockType *blocks;
+  // While the chunk is cold the blocks are run-length packed instead: the
+  // end index of every run, in storage order, followed by one type byte each
+  u16 *runs;
+  int run_count;
+  int solid_count; // non-air blocks, the section is freed when it drops to 0
+} ChunkSection;
+
+// How far a chunk has come through generation and meshing. A stage may need
+// the neighbours to have reached an earlier one first, see chunk_stage_ready;
+// today only meshing does. There is no lighting stage.
+typedef enum
+{
+  CHUNK_STAGE_NONE,      // allocated, no blocks yet
+  CHUNK_STAGE_TERRAIN,   // ground layered and caves carved
+  CHUNK_STAGE_DECORATED, // trees placed
+  CHUNK_STAGE_HEIGHTMAP, // column tops known
+  CHUNK_STAGE_MESHED,    // mesh built, though it may since have gone dirty
+  CHUNK_STAGES
+} ChunkStage;
+
+// Place of a chunk in one of the residency LRU lists
+typedef struct
+{
+  struct Chunk *prev; // more recently used
+  struct Chunk *next;
+  bool linked;
+} ChunkLink;
+
+enum
+{
+  LRU_VOXEL, // chunks holding their blocks, resident or parked
+  LRU_MESH,  // chunks holding mesh pages
+  LRU_LISTS
+};
+
+typedef struct Chunk
+{
+  int cx;
+  int cz;
+  u8 stage; // ChunkStage
+  ChunkSection *sections; // vertical column, grown on demand in either direction
+  int section_min;        // section index (y / SECTION_SIZE) of sections[0]
+  int section_count;
+  ChunkMesh mesh;
+  // Per column (z-major), the smallest y holding a non-air / opaque block,
+  // or COLUMN_EMPTY, and the type of the block at top_solid (BLOCK_AIR if
+  // empty). Kept while the blocks are unloaded.
+  int top_solid[CHUNK_SIZE * CHUNK_SIZE];
+  int top_opaque[CHUNK_SIZE * CHUNK_SIZE];
+  u8 top_type[CHUNK_SIZE * CHUNK_SIZE];
+  bool modified; // edited since generation, so it is parked rather than dropped
+  bool packed;   // some sections may be run-length packed
+  // Blocks dropped for the voxel budget: regenerated on use, or read back
+  // from the spill file if the chunk was modified
+  bool unloaded;
+  Uint32 used_ticks; // last time blocks were read, written or meshed
+  size_t voxel_bytes; // what the chunk adds to Residency.voxel_bytes
+  long spill_offset;  // slot in the spill file, spill_cap bytes long
+  size_t spill_cap;
+  ChunkLink lru[LRU_LISTS];
+} Chunk;
+
+// Sections of one chunk column as a snapshot saw them
+typedef struct
+{
+  const BlockType **sections; // NULL entries are all air
+  int section_min;
+  int section_count;
+} SnapshotColumn;
+
+// Read-only view of a rectangle of chunk columns at one moment. It holds a
+// reference on every section it sees, so later edits copy a section rather
+// than change it, and the snapshot can be read from any thread.
+typedef struct
+{
+  int cx0; // first chunk column
+  int cz0;
+  int w; // chunk columns along x and z
+  int d;
+  SnapshotColumn *columns; // z-major; empty where the chunk was not resident
+  const BlockType **storage;
+} ChunkSnapshot;
+
+// A small block template written into chunks in one go. Cells are y-major
+// (x fastest); BLOCK_AIR cells leave the world untouched.
+typedef struct
+{
+  int w; // x extent
+  int h; // y extent
+  int d; // z extent
+  int ox, oy, oz; // anchor cell, the one placed at the stamp position
+  const BlockType *blocks;
+} Structure;
+
+// Inclusive box of world block coordinates
+typedef struct
+{
+  int x0, y0, z0;
+  int x1, y1, z1;
+} BlockBox;
+
+typedef struct
+{
+  int x, y, z;
+  BlockType type;
+} BlockEdit;
+
+// A chunk written by a batch of edits and the columns edited in it
+typedef struct
+{
+  Chunk *chunk;
+  int lx0, lz0, lx1, lz1;
+  bool rescan; // column tops not kept up, rescanned by edit_batch_finish
+} EditTouch;
+
+// Edits collected so every chunk they touch is invalidated once at the end,
+// by edit_batch_finish. Starts zeroed.
+typedef struct
+{
+  EditTouch *touched;
+  int count;
+  int cap;
+  Chunk *last;  // chunk of the previous write
+  bool failed;  // out of memory; what was written is still invalidated
+} EditBatch;
+
+typedef struct
+{
+  Chunk **slots; // open addressing with linear probing, NULL when empty
+  int cap;       // power of two
+  int count;
+} ChunkMap;
+
+#define GEN_MAX_THREADS 8
+#define GEN_QUEUE_SIZE 64 // chunks handed to the generator threads at once
+
+typedef struct
+{
+  Chunk *chunk;
+  float priority; // lower runs sooner
+} GenJob;
+
+// Worker threads that generate chunks up to CHUNK_STAGE_HEIGHTMAP. Each
+// chunk belongs to exactly one thread from submission until it is collected,
+// so nothing else is shared.
+typedef struct
+{
+  SDL_Thread *threads[GEN_MAX_THREADS];
+  int thread_count; // 0 when generation runs on the main thread
+  SDL_mutex *lock;
+  SDL_cond *work;
+  GenJob jobs[GEN_QUEUE_SIZE]; // binary min-heap on priority
+  int job_count;
+  Chunk *done[GEN_QUEUE_SIZE];
+  int done_count;
+  bool quit;
+} GenPool;
+
+#define FAR_CELL 4 // blocks per far-terrain heightmap cell edge
+
+typedef struct
+{
+  Face *faces; // surface quads, then one skirt strip per edge
+  int face_count;
+  int skirt_start[5]; // edges (-x, +x, -z, +z); drawn only next to near chunks
+  int cx;
+  int cz;
+  bool dirty;
+} FarTile;
+
+typedef struct
+{
+  FarTile *tiles; // ring of chunk columns around the camera, wrapped by side
+  int side;
+  Texture colors[BLOCK_COUNT]; // 1x1 average top colour of each block but air
+} FarTerrain;
+
+typedef struct
+{
+  int cx;
+  int cz;
+} ChunkPos;
+
+// Chunks whose mesh may need building, each listed once. rebuild_faces
+// looks at these instead of the whole render distance, which it only rescans
+// when the camera enters another chunk or the distances change, since that
+// is what moves LOD levels and skirts.
+typedef struct
+{
+  ChunkPos *chunks;
+  int count;
+  int cap;
+  // Camera chunk and distances of the last full rescan
+  int scan_cx;
+  int scan_cz;
+  int scan_render_distance;
+  int scan_lod_distance[LOD_LEVELS - 1];
+  bool scanned;
+} MeshQueue;
+
+// Chunks in use order, most recent first
+typedef struct
+{
+  Chunk *head;
+  Chunk *tail;
+  int count;
+} ChunkList;
+
+// A stretch of the spill file, in use by a chunk or free
+typedef struct
+{
+  long offset;
+  size_t cap;
+} SpillSlot;
+
+// Memory caps for block data and chunk meshes, and what enforcing them did
+typedef struct
+{
+  size_t voxel_budget; // bytes of chunk data besides mesh pages, 0 for no cap
+  size_t mesh_budget;  // bytes of mesh pool slabs, 0 for no cap
+  size_t voxel_bytes;  // resident and parked chunks, see chunk_voxel_bytes
+  size_t mesh_bytes;
+  ChunkList lru[LRU_LISTS];
+  FILE *spill;         // blocks of modified chunks that were unloaded
+  long spill_end;
+  SpillSlot *spill_free; // slots given back, none touching another or the end
+  int spill_free_count;
+  int spill_free_cap;
+  int voxel_evicted;   // running totals
+  int voxel_reloaded;
+  int mesh_evicted;
+  int mesh_reloaded;
+} Residency;
+
 typedef struct
 {
   Game game;
   Camera camera;
-  Texture dirt_tex;
-  Texture stone_tex;
-  Texture grass_side_tex;
-  Texture grass_top_tex;
-  Texture oak_log_side_tex;
-  Texture oak_log_top_tex;
-  Texture oak_planks_tex;
-  Texture cobblestone_tex;
-  Texture leaves_tex;
-  Texture glass_tex;
+  Texture block_tex[TEX_COUNT];
   Texture sky_tex;
   BlockType selected_block;
   bool wireframe;
   bool noclip;
+  bool cave_culling;
   float fps;
   int culled_faces_count;
   int rendered_faces_count;
+  int shaded_pixels_count;
+  int visible_sections_count;
   v3f velocity;
   bool grounded;
   Uint32 last_ticks;
@@ -91,18 +412,28 @@ typedef struct
   float near_plane;
   float far_plane;
   float mouse_sens;
-  Face *faces;
-  int face_count;
-  int face_cap;
-  BlockType *blocks;
-  int size_x;
-  int size_z;
-  int y_min;
+  ChunkMap chunks; // resident chunks around the camera
+  ChunkMap parked; // edited chunks that left the load distance
+  ChunkMap generating; // submitted to gen_pool and not collected yet
+  GenPool gen_pool;
+  MeshPool mesh_pool;
+  Arena frame_arena; // streaming and render scratch, reset every frame
+  FarTerrain far;
+  int y_min; // extent of every section allocated so far, in blocks
   int y_max;
   int render_distance_chunks;
+  int load_distance_chunks;
+  int far_distance_chunks;
+  int lod_distance_chunks[LOD_LEVELS - 1]; // chunk distance where LOD 1.. start
   int chunk_cx;
   int chunk_cz;
+  bool stream_pending; // chunks within the load distance still to generate
   bool mesh_dirty;
+  MeshQueue mesh_queue;
+  float mesh_budget_ms; // meshing time allowed per frame, 0 for no limit
+  Uint32 world_ticks; // clock for chunk use, set at the start of mc_frame
+  int pack_cursor;    // next chunk map slot world_pack_cold looks at
+  Residency residency;
 } Mc;
 
 bool mc_init(Mc *mc);
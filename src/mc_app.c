@@ -1,5 +1,11 @@
 #include "mc.h"
 #include "world.h"
+#include "blocks.h"
+#include "chunk_map.h"
+#include "far_terrain.h"
+#include "gen_pool.h"
+#include "cull.h"
+#include "mesh_pool.h"
 #include "colors.h"
 #include "math.h"
 #include "render.h"
@@ -25,6 +31,13 @@ typedef struct
   float depth;
 } TransparentFace;
 
+typedef struct
+{
+  int cx;
+  int cz;
+  float dist_sq;
+} ChunkOrder;
+
 static v3f camera_forward(const Camera *cam)
 {
   float cy = cosf(cam->yaw);
@@ -118,162 +131,6 @@ static void draw_sky(Mc *mc, float fov, float aspect, v3f forward, v3f right,
   }
 }
 
-static float hash2i(int x, int z)
-{
-  // Integer hash, returns [0,1)
-  uint32_t h = (uint32_t)(x * 374761393u + z * 668265263u);
-  h = (h ^ (h >> 13)) * 1274126177u;
-  h ^= (h >> 16);
-  return (float)h / 4294967295.0f;
-}
-
-static float value_noise(float x, float z)
-{
-  int xi = (int)floorf(x);
-  int zi = (int)floorf(z);
-  float xf = x - (float)xi;
-  float zf = z - (float)zi;
-  float v00 = hash2i(xi, zi);
-  float v10 = hash2i(xi + 1, zi);
-  float v01 = hash2i(xi, zi + 1);
-  float v11 = hash2i(xi + 1, zi + 1);
-  float tx = xf * xf * (3.0f - 2.0f * xf);
-  float tz = zf * zf * (3.0f - 2.0f * zf);
-  float xa = v00 * (1.0f - tx) + v10 * tx;
-  float xb = v01 * (1.0f - tx) + v11 * tx;
-  return xa * (1.0f - tz) + xb * tz;
-}
-
-static float fbm2(float x, float z, int octaves, float lacunarity, float gain)
-{
-  float amp = 1.0f;
-  float freq = 1.0f;
-  float sum = 0.0f;
-  float norm = 0.0f;
-  for (int i = 0; i < octaves; i++)
-  {
-    sum += value_noise(x * freq, z * freq) * amp;
-    norm += amp;
-    amp *= gain;
-    freq *= lacunarity;
-  }
-  return (norm > 0.0f) ? (sum / norm) : 0.0f;
-}
-
-// Checks that all blocks between y0 and y1 (inclusive) are air; order of y0/y1
-// does not matter.
-static bool column_is_clear(const Mc *mc, int x, int y0, int y1, int z)
-{
-  int step = (y0 <= y1) ? 1 : -1;
-  for (int y = y0; y != y1 + step; y += step)
-  {
-    if (block_get(mc, x, y, z) != BLOCK_AIR)
-    {
-      return false;
-    }
-  }
-  return true;
-}
-
-static void place_tree(Mc *mc, int x, int y, int z, int trunk_h)
-{
-  for (int i = 0; i < trunk_h; i++)
-  {
-    block_set(mc, x, y - i, z, BLOCK_OAK_LOG);
-  }
-  int trunk_top = y - (trunk_h - 1);
-  int canopy_base = trunk_top - 1;
-  for (int ly = 0; ly <= 2; ly++)
-  {
-    int yy = canopy_base - ly;
-    if (yy < mc->y_min)
-      break;
-    int radius = (ly == 2) ? 1 : 2;
-    for (int dx = -radius; dx <= radius; dx++)
-    {
-      for (int dz = -radius; dz <= radius; dz++)
-      {
-        if (abs(dx) + abs(dz) > radius + 1)
-          continue;
-        int px = x + dx;
-        int pz = z + dz;
-        if (block_get(mc, px, yy, pz) == BLOCK_AIR)
-        {
-          block_set(mc, px, yy, pz, BLOCK_LEAVES);
-        }
-      }
-    }
-  }
-  int top_leaf_y = canopy_base - 3;
-  if (top_leaf_y >= mc->y_min && block_get(mc, x, top_leaf_y, z) == BLOCK_AIR)
-  {
-    block_set(mc, x, top_leaf_y, z, BLOCK_LEAVES);
-  }
-}
-
-static void try_place_tree(Mc *mc, int x, int z, float chance)
-{
-  float roll = hash2i(x * 31, z * 17);
-  if (roll >= chance)
-  {
-    return;
-  }
-
-  int top_y = -1;
-  for (int y = mc->y_min; y <= mc->y_max; y++)
-  {
-    BlockType t = block_get(mc, x, y, z);
-    if (t != BLOCK_AIR)
-    {
-      top_y = y;
-      break;
-    }
-  }
-  if (top_y < 0)
-    return;
-
-  BlockType ground = block_get(mc, x, top_y, z);
-  if (ground != BLOCK_GRASS)
-    return;
-
-  int trunk_h = 4 + (int)(hash2i(x * 13, z * 29) * 3.0f); // 4-6 tall
-  int clear_to = top_y - trunk_h - 2;
-  if (clear_to < mc->y_min)
-    return;
-
-  if (!column_is_clear(mc, x, top_y - 1, clear_to, z))
-    return;
-
-  place_tree(mc, x, top_y - 1, z, trunk_h);
-}
-
-static const char *block_name(BlockType t)
-{
-  switch (t)
-  {
-  case BLOCK_AIR:
-    return "NONE";
-  case BLOCK_GRASS:
-    return "GRASS";
-  case BLOCK_DIRT:
-    return "DIRT";
-  case BLOCK_STONE:
-    return "STONE";
-  case BLOCK_OAK_LOG:
-    return "OAK LOG";
-  case BLOCK_OAK_PLANKS:
-    return "OAK PLANKS";
-  case BLOCK_COBBLESTONE:
-    return "COBBLESTONE";
-  case BLOCK_LEAVES:
-    return "LEAVES";
-  case BLOCK_GLASS:
-    return "GLASS";
-  default:
-    return "UNKNOWN";
-  }
-}
-
 static float face_view_depth(const Face *face, const mat4 *mv)
 {
   v3f center = {(face->v[0].pos.x + face->v[1].pos.x + face->v[2].pos.x) / 3.0f,
@@ -294,6 +151,17 @@ static int compare_transparent_face(const void *a, const void *b)
   return 0;
 }
 
+static int compare_chunk_order(const void *a, const void *b)
+{
+  float da = ((const ChunkOrder *)a)->dist_sq;
+  float db = ((const ChunkOrder *)b)->dist_sq;
+  if (da < db)
+    return -1;
+  if (da > db)
+    return 1;
+  return 0;
+}
+
 static inline u32 blend_argb(u32 src, u32 dst, u8 alpha)
 {
   u8 src_r = (src >> 16) & 0xFF;
@@ -314,36 +182,10 @@ static inline u32 blend_argb(u32 src, u32 dst, u8 alpha)
 static void block_preview_texture(const Mc *mc, BlockType t,
                                   const Texture **main_tex)
 {
-  *main_tex = NULL;
-  switch (t)
-  {
-  case BLOCK_GRASS:
-    *main_tex = &mc->grass_side_tex;
-    break;
-  case BLOCK_OAK_LOG:
-    *main_tex = &mc->oak_log_side_tex;
-    break;
-  case BLOCK_DIRT:
-    *main_tex = &mc->dirt_tex;
-    break;
-  case BLOCK_STONE:
-    *main_tex = &mc->stone_tex;
-    break;
-  case BLOCK_OAK_PLANKS:
-    *main_tex = &mc->oak_planks_tex;
-    break;
-  case BLOCK_COBBLESTONE:
-    *main_tex = &mc->cobblestone_tex;
-    break;
-  case BLOCK_LEAVES:
-    *main_tex = &mc->leaves_tex;
-    break;
-  case BLOCK_GLASS:
-    *main_tex = &mc->glass_tex;
-    break;
-  default:
-    break;
-  }
+  const BlockInfo *info = &block_info[t];
+  *main_tex = (info->opacity == BLOCK_EMPTY)
+                  ? NULL
+                  : &mc->block_tex[info->tex[BLOCK_FACE_SIDE]];
 }
 
 static void draw_filled_rect(u32 *buffer, int bw, int bh, int x0, int y0, int x1,
@@ -567,6 +409,226 @@ static bool project_vertex(const ClipVert *cv, const mat4 *proj, int render_w,
   return true;
 }
 
+typedef struct
+{
+  v2i screen;
+  v2f uv;
+  v3f view_pos;
+  float inv_w;
+  float depth;
+  int clip_mask;
+  bool depth_ok;
+} CachedVertex;
+
+static void draw_face(Mc *mc, Face *face, const mat4 *mv, const mat4 *proj,
+                      bool is_transparent)
+{
+  Game *game = &mc->game;
+  CachedVertex tri[3];
+
+  for (int j = 0; j < 3; j++)
+  {
+    v4f world = {face->v[j].pos.x, face->v[j].pos.y, face->v[j].pos.z, 1.0f};
+    v4f view_pos4 = mat4_mul_v4(*mv, world);
+    v4f clip = mat4_mul_v4(*proj, view_pos4);
+
+    tri[j].uv = face->v[j].uv;
+    tri[j].view_pos = (v3f){view_pos4.x, view_pos4.y, view_pos4.z};
+
+    int mask = 0;
+    if (clip.w == 0.0f)
+    {
+      return; // degenerate, force cull
+    }
+    if (clip.x < -clip.w)
+      mask |= 1;
+    if (clip.x > clip.w)
+      mask |= 2;
+    if (clip.y < -clip.w)
+      mask |= 4;
+    if (clip.y > clip.w)
+      mask |= 8;
+    if (clip.z < 0.0f)
+      mask |= 16;
+    if (clip.z > clip.w)
+      mask |= 32;
+    tri[j].clip_mask = mask;
+
+    float inv_w = 1.0f / clip.w;
+    tri[j].inv_w = inv_w;
+    v3f ndc = {clip.x * inv_w, clip.y * inv_w, clip.z * inv_w};
+    tri[j].depth_ok = ndc.z >= -1.0f && ndc.z <= 1.0f;
+    tri[j].screen =
+        norm_to_screen((v2f){ndc.x, ndc.y}, game->render_w, game->render_h);
+    tri[j].depth = 0.5f * (ndc.z + 1.0f);
+  }
+
+  if ((tri[0].clip_mask & tri[1].clip_mask & tri[2].clip_mask) != 0)
+  {
+    mc->culled_faces_count++;
+    return; // frustum culled
+  }
+
+  bool near_in[3] = {tri[0].view_pos.z <= -mc->near_plane,
+                     tri[1].view_pos.z <= -mc->near_plane,
+                     tri[2].view_pos.z <= -mc->near_plane};
+  bool needs_clip = !(near_in[0] && near_in[1] && near_in[2]);
+
+  if (!needs_clip)
+  {
+    if (!tri[0].depth_ok || !tri[1].depth_ok || !tri[2].depth_ok)
+    {
+      return;
+    }
+    v3f edge1 = v3_sub(tri[1].view_pos, tri[0].view_pos);
+    v3f edge2 = v3_sub(tri[2].view_pos, tri[0].view_pos);
+    v3f normal = v3_cross(edge1, edge2);
+    if (v3_dot(normal, tri[0].view_pos) >= 0.0f)
+    {
+      return;
+    }
+    VertexPC pv[3] = {
+        {.pos = tri[0].screen, .uv = tri[0].uv, .inv_w = tri[0].inv_w, .depth = tri[0].depth},
+        {.pos = tri[1].screen, .uv = tri[1].uv, .inv_w = tri[1].inv_w, .depth = tri[1].depth},
+        {.pos = tri[2].screen, .uv = tri[2].uv, .inv_w = tri[2].inv_w, .depth = tri[2].depth},
+    };
+
+    if (mc->wireframe)
+    {
+      draw_triangle(game->buffer, game->render_w, game->render_h, pv[0].pos,
+                    pv[1].pos, pv[2].pos, WHITE, WIREFRAME);
+    }
+    else if (is_transparent)
+    {
+      mc->shaded_pixels_count += draw_textured_triangle_alpha(
+          game->buffer, game->depth, game->render_w, game->render_h, face->tex,
+          pv[0], pv[1], pv[2], false);
+    }
+    else
+    {
+      mc->shaded_pixels_count += draw_textured_triangle(
+          game->buffer, game->depth, game->render_w, game->render_h, face->tex,
+          pv[0], pv[1], pv[2]);
+    }
+    mc->rendered_faces_count++;
+    return;
+  }
+
+  ClipVert in_poly[4] = {
+      {.view_pos = tri[0].view_pos, .uv = tri[0].uv},
+      {.view_pos = tri[1].view_pos, .uv = tri[1].uv},
+      {.view_pos = tri[2].view_pos, .uv = tri[2].uv},
+  };
+  int in_count = 3;
+  ClipVert out_poly[4];
+  int out_count = 0;
+
+  for (int v = 0; v < in_count; v++)
+  {
+    ClipVert a = in_poly[v];
+    ClipVert b = in_poly[(v + 1) % in_count];
+    bool a_in = a.view_pos.z <= -mc->near_plane;
+    bool b_in = b.view_pos.z <= -mc->near_plane;
+
+    if (a_in && b_in)
+    {
+      out_poly[out_count++] = b;
+    }
+    else if (a_in && !b_in)
+    {
+      float t = (-mc->near_plane - a.view_pos.z) /
+                (b.view_pos.z - a.view_pos.z);
+      ClipVert inter = {
+          .view_pos = {a.view_pos.x + (b.view_pos.x - a.view_pos.x) * t,
+                       a.view_pos.y + (b.view_pos.y - a.view_pos.y) * t,
+                       -mc->near_plane},
+          .uv = {a.uv.x + (b.uv.x - a.uv.x) * t,
+                 a.uv.y + (b.uv.y - a.uv.y) * t}};
+      out_poly[out_count++] = inter;
+    }
+    else if (!a_in && b_in)
+    {
+      float t = (-mc->near_plane - a.view_pos.z) /
+                (b.view_pos.z - a.view_pos.z);
+      ClipVert inter = {
+          .view_pos = {a.view_pos.x + (b.view_pos.x - a.view_pos.x) * t,
+                       a.view_pos.y + (b.view_pos.y - a.view_pos.y) * t,
+                       -mc->near_plane},
+          .uv = {a.uv.x + (b.uv.x - a.uv.x) * t,
+                 a.uv.y + (b.uv.y - a.uv.y) * t}};
+      out_poly[out_count++] = inter;
+      out_poly[out_count++] = b;
+    }
+  }
+
+  if (out_count < 3)
+  {
+    return;
+  }
+
+  int tri_sets[2][3] = {{0, 1, 2}, {0, 2, 3}};
+  int tri_total = (out_count == 4) ? 2 : 1;
+
+  for (int t = 0; t < tri_total; t++)
+  {
+    ClipVert *a = &out_poly[tri_sets[t][0]];
+    ClipVert *b = &out_poly[tri_sets[t][1]];
+    ClipVert *c = &out_poly[tri_sets[t][2]];
+
+    v3f edge1 = v3_sub(b->view_pos, a->view_pos);
+    v3f edge2 = v3_sub(c->view_pos, a->view_pos);
+    v3f normal = v3_cross(edge1, edge2);
+    if (v3_dot(normal, a->view_pos) >= 0.0f)
+    {
+      continue;
+    }
+
+    VertexPC pv[3];
+    int masks[3];
+    if (!project_vertex(a, proj, game->render_w, game->render_h, &pv[0],
+                        &masks[0]) ||
+        !project_vertex(b, proj, game->render_w, game->render_h, &pv[1],
+                        &masks[1]) ||
+        !project_vertex(c, proj, game->render_w, game->render_h, &pv[2],
+                        &masks[2]))
+    {
+      continue;
+    }
+    if ((masks[0] & masks[1] & masks[2]) != 0)
+    {
+      continue;
+    }
+
+    if (mc->wireframe)
+    {
+      draw_triangle(game->buffer, game->render_w, game->render_h, pv[0].pos,
+                    pv[1].pos, pv[2].pos, WHITE, WIREFRAME);
+    }
+    else if (is_transparent)
+    {
+      mc->shaded_pixels_count += draw_textured_triangle_alpha(
+          game->buffer, game->depth, game->render_w, game->render_h, face->tex,
+          pv[0], pv[1], pv[2], false);
+    }
+    else
+    {
+      mc->shaded_pixels_count += draw_textured_triangle(
+          game->buffer, game->depth, game->render_w, game->render_h, face->tex,
+          pv[0], pv[1], pv[2]);
+    }
+    mc->rendered_faces_count++;
+  }
+}
+
+static void destroy_textures(Mc *mc)
+{
+  for (int i = 0; i < TEX_COUNT; i++)
+  {
+    texture_destroy(&mc->block_tex[i]);
+  }
+  texture_destroy(&mc->sky_tex);
+}
+
 bool mc_init(Mc *mc)
 {
   *mc = (Mc){0};
@@ -579,14 +641,18 @@ bool mc_init(Mc *mc)
   mc->camera = (Camera){.pos = {0.0f, 1.5f, 6.0f}, .yaw = 0.0f, .pitch = 0.0f};
   resize_render(&mc->game, (int)mc->game.window_w,
                 (int)mc->game.window_h, mc->render_scale);
-  mc->size_x = CHUNK_SIZE * 32; 
-  mc->size_z = CHUNK_SIZE * 32;
   mc->y_min = 0;
   mc->y_max = 31;
-  mc->render_distance_chunks = 4; // initial render distance
-  mc->chunk_cx = -1;
-  mc->chunk_cz = -1;
+  mc->render_distance_chunks = 16; // initial render distance
+  mc->load_distance_chunks = mc->render_distance_chunks + 1; // meshing halo
+  mc->far_distance_chunks = 24;
+  mc->cave_culling = true;
+  mc->lod_distance_chunks[0] = 4;  // 2x2x2 cells from here
+  mc->lod_distance_chunks[1] = 8;  // 4x4x4 cells from here
   mc->selected_block = BLOCK_DIRT;
+  mc->residency.voxel_budget = (size_t)32 << 20;
+  mc->residency.mesh_budget = (size_t)48 << 20;
+  mc->mesh_budget_ms = MESH_BUDGET_MS;
 
   if (SDL_Init(SDL_INIT_VIDEO) != 0)
   {
@@ -602,18 +668,14 @@ bool mc_init(Mc *mc)
     return false;
   }
 
-  if (!load_texture(&mc->dirt_tex, "assets/dirt.png") ||
-      !load_texture(&mc->stone_tex, "assets/stone.png") ||
-      !load_texture(&mc->grass_side_tex, "assets/grass_side.png") ||
-      !load_texture(&mc->grass_top_tex, "assets/grass_top.png") ||
-      !load_texture(&mc->oak_log_side_tex, "assets/oak_log_side.png") ||
-      !load_texture(&mc->oak_log_top_tex, "assets/oak_log_top.png") ||
-      !load_texture(&mc->oak_planks_tex, "assets/oak_planks.png") ||
-      !load_texture(&mc->cobblestone_tex, "assets/cobblestone.png") ||
-      !load_texture(&mc->leaves_tex, "assets/leaves.png") ||
-      !load_texture(&mc->glass_tex, "assets/glass.png") ||
-      !load_texture(&mc->sky_tex, "assets/sky.png"))
+  bool loaded = true;
+  for (int i = 0; i < TEX_COUNT && loaded; i++)
   {
+    loaded = load_texture(&mc->block_tex[i], block_tex_paths[i]);
+  }
+  if (!loaded || !load_texture(&mc->sky_tex, "assets/sky.png"))
+  {
+    destroy_textures(mc);
     IMG_Quit();
     SDL_Quit();
     return false;
@@ -627,8 +689,7 @@ bool mc_init(Mc *mc)
   if (mc->game.window == NULL)
   {
     SDL_Log("Failed to create Window: %s\n", SDL_GetError());
-    texture_destroy(&mc->dirt_tex);
-    texture_destroy(&mc->stone_tex);
+    destroy_textures(mc);
     IMG_Quit();
     SDL_Quit();
     return false;
@@ -641,8 +702,7 @@ bool mc_init(Mc *mc)
   {
     SDL_Log("Failed to create Renderer: %s\n", SDL_GetError());
     SDL_DestroyWindow(mc->game.window);
-    texture_destroy(&mc->dirt_tex);
-    texture_destroy(&mc->stone_tex);
+    destroy_textures(mc);
     IMG_Quit();
     SDL_Quit();
     return false;
@@ -662,68 +722,46 @@ bool mc_init(Mc *mc)
   mc->running = true;
   mc->game.inventory_open = false;
 
-  int block_count = mc->size_x * (mc->y_max - mc->y_min + 1) * mc->size_z;
-  mc->blocks = calloc((size_t)block_count, sizeof(BlockType));
-  const float scale = 0.08f;
-  const int dirt_depth = 3;
-  const int stone_start = 12;
-  for (int x = 0; x < mc->size_x; x++)
+  if (!gen_pool_init(&mc->gen_pool))
   {
-    for (int z = 0; z < mc->size_z; z++)
+    SDL_Log("No world generation threads, generating on the main thread");
+  }
+  world_stream(mc);
+  // Start out standing on the highest ground nearby rather than at the
+  // bottom of whatever cave or pit the spawn column may be
+  int spawn_x = (int)floorf(mc->camera.pos.x);
+  int spawn_z = (int)floorf(mc->camera.pos.z);
+  int ground = COLUMN_EMPTY;
+  for (int dz = -4; dz <= 4; dz++)
+  {
+    for (int dx = -4; dx <= 4; dx++)
     {
-      float h = fbm2((float)x * scale, (float)z * scale, 4, 2.0f, 0.5f);
-      int surface = stone_start + (int)(h * 8.0f); // 1..9 ish
-      if (surface > mc->y_max)
-        surface = mc->y_max;
-      if (surface < 1)
-        surface = 1;
-      int dirt_end = surface + dirt_depth;
-      if (dirt_end > mc->y_max)
-        dirt_end = mc->y_max;
-      for (int y = surface; y <= mc->y_max; y++)
+      int top = column_top(mc, spawn_x + dx, spawn_z + dz, true);
+      if (top < ground)
       {
-        BlockType t;
-        if (y == surface)
-        {
-          t = BLOCK_GRASS;
-        }
-        else if (y <= dirt_end)
-        {
-          t = BLOCK_DIRT;
-        }
-        else
-        {
-          t = BLOCK_STONE;
-        }
-        block_set(mc, x, y, z, t);
+        ground = top;
+        mc->camera.pos.x = (float)(spawn_x + dx) + 0.5f;
+        mc->camera.pos.z = (float)(spawn_z + dz) + 0.5f;
       }
     }
   }
-
-  const float tree_chance = 0.01f; // denser trees
-  for (int x = 0; x < mc->size_x; x++)
+  if (ground != COLUMN_EMPTY)
   {
-    for (int z = 0; z < mc->size_z; z++)
-    {
-      try_place_tree(mc, x, z, tree_chance);
-    }
+    mc->camera.pos.y = -(float)ground + PLAYER_HEIGHT;
   }
-  rebuild_faces(mc);
+  if (!far_terrain_init(mc))
+  {
+    SDL_Log("Failed to allocate far terrain");
+  }
+  rebuild_faces(mc, 0.0f);
   return true;
 }
 
 void mc_shutdown(Mc *mc)
 {
-  if (mc->faces)
-  {
-    free(mc->faces);
-    mc->faces = NULL;
-  }
-  if (mc->blocks)
-  {
-    free(mc->blocks);
-    mc->blocks = NULL;
-  }
+  world_free(mc);
+  far_terrain_free(mc);
+  arena_free(&mc->frame_arena);
   if (mc->game.buffer)
   {
     free(mc->game.buffer);
@@ -734,17 +772,7 @@ void mc_shutdown(Mc *mc)
     free(mc->game.depth);
     mc->game.depth = NULL;
   }
-  texture_destroy(&mc->dirt_tex);
-  texture_destroy(&mc->stone_tex);
-  texture_destroy(&mc->grass_side_tex);
-  texture_destroy(&mc->grass_top_tex);
-  texture_destroy(&mc->oak_log_side_tex);
-  texture_destroy(&mc->oak_log_top_tex);
-  texture_destroy(&mc->oak_planks_tex);
-  texture_destroy(&mc->cobblestone_tex);
-  texture_destroy(&mc->leaves_tex);
-  texture_destroy(&mc->glass_tex);
-  texture_destroy(&mc->sky_tex);
+  destroy_textures(mc);
   if (mc->game.texture)
   {
     SDL_DestroyTexture(mc->game.texture);
@@ -838,6 +866,14 @@ void mc_handle_event(Mc *mc, const SDL_Event *event)
     {
       mc->wireframe = !mc->wireframe;
     }
+    if (event->key.keysym.sym == SDLK_c)
+    {
+      mc->cave_culling = !mc->cave_culling;
+    }
+    if (event->key.keysym.sym == SDLK_m)
+    {
+      mc->mesh_budget_ms = (mc->mesh_budget_ms > 0.0f) ? 0.0f : MESH_BUDGET_MS;
+    }
     if (event->key.keysym.sym == SDLK_q)
     {
       game->mouse_grabbed = !game->mouse_grabbed;
@@ -914,6 +950,9 @@ void mc_frame(Mc *mc, Uint32 now, float dt)
   const float world_up_y = 1.0f;
   mc->culled_faces_count = 0;
   mc->rendered_faces_count = 0;
+  mc->shaded_pixels_count = 0;
+  arena_reset(&mc->frame_arena);
+  mc->world_ticks = now;
 
   const Uint8 *state = SDL_GetKeyboardState(NULL);
   v3f forward_move = camera_forward(&mc->camera);
@@ -1070,17 +1109,21 @@ void mc_frame(Mc *mc, Uint32 now, float dt)
     resolve_collisions(mc);
   }
 
-  // Trigger mesh rebuild when crossing chunk boundaries
-  int cam_block_x = (int)floorf(mc->camera.pos.x + (float)mc->size_x * 0.5f);
-  int cam_block_z = (int)floorf(mc->camera.pos.z + (float)mc->size_z * 0.5f);
-  int cam_chunk_x = cam_block_x / CHUNK_SIZE;
-  int cam_chunk_z = cam_block_z / CHUNK_SIZE;
+  // Trigger mesh rebuild when crossing chunk boundaries, and keep generating
+  // chunks until everything within the load distance is in
+  int cam_chunk_x, cam_chunk_z;
+  camera_chunk(mc, &cam_chunk_x, &cam_chunk_z);
   if (cam_chunk_x != mc->chunk_cx || cam_chunk_z != mc->chunk_cz)
   {
-    mc->chunk_cx = cam_chunk_x;
-    mc->chunk_cz = cam_chunk_z;
+    world_stream(mc);
     mc->mesh_dirty = true;
   }
+  else if (mc->stream_pending)
+  {
+    world_stream(mc);
+  }
+  world_pack_cold(mc);
+  world_enforce_budget(mc);
 
   const float fov = (float)M_PI / 3.0f;
   float aspect = (float)game->render_w / (float)game->render_h;
@@ -1092,7 +1135,7 @@ void mc_frame(Mc *mc, Uint32 now, float dt)
   clear_depth(game->depth, (size_t)game->render_w * (size_t)game->render_h);
   if (mc->mesh_dirty)
   {
-    rebuild_faces(mc);
+    rebuild_faces(mc, mc->mesh_budget_ms);
   }
 
   mat4 model = mat4_identity();
@@ -1102,32 +1145,140 @@ void mc_frame(Mc *mc, Uint32 now, float dt)
   mat4 proj = mat4_perspective(fov, aspect, mc->near_plane, mc->far_plane);
   mat4 mv = mat4_mul(view, model);
 
+  // Sections come from a search outward from the camera, so opaque faces are
+  // submitted roughly front to back and the depth test rejects what they hide
+  // before it is shaded. Sections sealed off by solid blocks are never
+  // reached. Chunks outside the render distance contribute their far tile,
+  // nearest first, unless the search never got to the render border.
+  mat4 mvp = mat4_mul(proj, mv);
+  int r = mc->render_distance_chunks;
+  Arena *scratch = &mc->frame_arena;
+  VisibleSection *visible =
+      ARENA_ALLOC(scratch, VisibleSection, cull_section_capacity(mc));
+  int visible_count = 0;
+  bool show_far = false;
+  if (visible)
+  {
+    visible_count = cull_visible_sections(mc, &mvp, scratch, visible, &show_far);
+  }
+  mc->visible_sections_count = visible_count;
+
+  int total_faces = 0;
+  for (int k = 0; k < visible_count; k++)
+  {
+    const SectionMesh *section =
+        section_mesh_get(mc, visible[k].cx, visible[k].sy, visible[k].cz);
+    total_faces += section->group_start[MESH_GROUPS] - section->group_start[0];
+  }
+
+  // Far tiles are built under the meshing time budget; chunks whose tile is
+  // not built yet are left out until it is.
+  if (show_far)
+  {
+    far_terrain_update(mc, mc->mesh_budget_ms);
+  }
+  int f = mc->far_distance_chunks;
+  ChunkOrder *order =
+      show_far ? ARENA_ALLOC(scratch, ChunkOrder, (2 * f + 1) * (2 * f + 1)) : NULL;
+  int far_count = 0;
+  if (order)
+  {
+    for (int cz = mc->chunk_cz - f; cz <= mc->chunk_cz + f; cz++)
+    {
+      for (int cx = mc->chunk_cx - f; cx <= mc->chunk_cx + f; cx++)
+      {
+        // Inside the render distance the tile stands in for chunks with no
+        // mesh to draw: not generated or meshed yet, or evicted. A dirty
+        // mesh keeps drawing its old faces until it is rebuilt.
+        if (abs(cx - mc->chunk_cx) <= r && abs(cz - mc->chunk_cz) <= r)
+        {
+          const Chunk *chunk = chunk_map_get(&mc->chunks, cx, cz);
+          if (chunk && chunk->stage == CHUNK_STAGE_MESHED)
+          {
+            continue;
+          }
+        }
+        FarTile *tile = far_terrain_tile(mc, cx, cz);
+        if (!tile)
+        {
+          continue;
+        }
+        float dx = (float)(cx * CHUNK_SIZE + CHUNK_SIZE / 2) - mc->camera.pos.x;
+        float dz = (float)(cz * CHUNK_SIZE + CHUNK_SIZE / 2) - mc->camera.pos.z;
+        ChunkOrder *o = &order[far_count++];
+        o->cx = cx;
+        o->cz = cz;
+        o->dist_sq = dx * dx + dz * dz;
+        total_faces += tile->face_count;
+      }
+    }
+    qsort(order, (size_t)far_count, sizeof(ChunkOrder), compare_chunk_order);
+  }
+
   Face **render_faces = NULL;
   TransparentFace *transparent_faces = NULL;
-  int total_faces = mc->face_count;
-  if (mc->face_count > 0)
+  if (total_faces > 0)
   {
-    render_faces = malloc((size_t)mc->face_count * sizeof(Face *));
-    transparent_faces = malloc((size_t)mc->face_count * sizeof(TransparentFace));
+    render_faces = ARENA_ALLOC(scratch, Face *, total_faces);
+    transparent_faces = ARENA_ALLOC(scratch, TransparentFace, total_faces);
   }
   int opaque_count = 0;
   int transparent_count = 0;
   bool have_order = render_faces && transparent_faces;
   if (have_order)
   {
-  for (int face_idx = 0; face_idx < total_faces; face_idx++)
+    for (int k = 0; k < visible_count; k++)
     {
-      Face *face = &mc->faces[face_idx];
-      bool is_transparent = (face->tex == &mc->glass_tex) || (face->tex == &mc->leaves_tex);
-      if (is_transparent)
+      int cx = visible[k].cx;
+      int sy = visible[k].sy;
+      int cz = visible[k].cz;
+      ChunkMesh *mesh = chunk_mesh_get(mc, cx, cz);
+      const SectionMesh *section = section_mesh_get(mc, cx, sy, cz);
+      for (int group = 0; group < MESH_GROUP_TRANSPARENT; group++)
       {
+        if (!section_group_faces_eye(cx, sy, cz, group, mc->camera.pos))
+        {
+          continue; // every face in the group is a back face
+        }
+        for (int i = section->group_start[group]; i < section->group_start[group + 1];
+             i++)
+        {
+          render_faces[opaque_count++] = chunk_mesh_face(mesh, i);
+        }
+      }
+      for (int i = section->group_start[MESH_GROUP_TRANSPARENT];
+           i < section->group_start[MESH_GROUPS]; i++)
+      {
+        Face *face = chunk_mesh_face(mesh, i);
         transparent_faces[transparent_count].face = face;
         transparent_faces[transparent_count].depth = face_view_depth(face, &mv);
         transparent_count++;
       }
-      else
+    }
+
+    for (int k = 0; k < far_count; k++)
+    {
+      int cx = order[k].cx;
+      int cz = order[k].cz;
+      FarTile *tile = far_terrain_tile(mc, cx, cz);
+      for (int i = 0; i < tile->skirt_start[0]; i++)
+      {
+        render_faces[opaque_count++] = &tile->faces[i];
+      }
+      // Skirts only face the voxel region
+      static const int ndx[4] = {-1, 1, 0, 0};
+      static const int ndz[4] = {0, 0, -1, 1};
+      for (int e = 0; e < 4; e++)
       {
-        render_faces[opaque_count++] = face;
+        if (abs(cx + ndx[e] - mc->chunk_cx) > r ||
+            abs(cz + ndz[e] - mc->chunk_cz) > r)
+        {
+          continue;
+        }
+        for (int i = tile->skirt_start[e]; i < tile->skirt_start[e + 1]; i++)
+        {
+          render_faces[opaque_count++] = &tile->faces[i];
+        }
       }
     }
     if (transparent_count > 1)
@@ -1143,234 +1294,15 @@ void mc_frame(Mc *mc, Uint32 now, float dt)
   }
   else
   {
-    free(render_faces);
-    free(transparent_faces);
-    render_faces = NULL;
-    transparent_faces = NULL;
+    total_faces = 0;
   }
 
-  typedef struct
-  {
-    v2i screen;
-    v2f uv;
-    v3f view_pos;
-    float inv_w;
-    float depth;
-    int clip_mask;
-    bool depth_ok;
-  } CachedVertex;
-  CachedVertex tri[3];
-
   for (int face_idx = 0; face_idx < total_faces; face_idx++)
   {
-    Face *face =
-        render_faces ? render_faces[face_idx] : &mc->faces[face_idx];
-    bool is_transparent = (face->tex == &mc->glass_tex) || (face->tex == &mc->leaves_tex);
-
-      bool skip = false;
-      for (int j = 0; j < 3; j++)
-      {
-        v4f world = {face->v[j].pos.x, face->v[j].pos.y, face->v[j].pos.z,
-                     1.0f};
-        v4f view_pos4 = mat4_mul_v4(mv, world);
-        v4f clip = mat4_mul_v4(proj, view_pos4);
-
-        tri[j].uv = face->v[j].uv;
-        tri[j].view_pos = (v3f){view_pos4.x, view_pos4.y, view_pos4.z};
-
-        int mask = 0;
-        if (clip.w == 0.0f)
-        {
-          tri[j].clip_mask = 0x3F; // force cull
-          tri[j].depth_ok = false;
-          skip = true;
-          break;
-        }
-        if (clip.x < -clip.w)
-          mask |= 1;
-        if (clip.x > clip.w)
-          mask |= 2;
-        if (clip.y < -clip.w)
-          mask |= 4;
-        if (clip.y > clip.w)
-          mask |= 8;
-        if (clip.z < 0.0f)
-          mask |= 16;
-        if (clip.z > clip.w)
-          mask |= 32;
-        tri[j].clip_mask = mask;
-
-        float inv_w = 1.0f / clip.w;
-        tri[j].inv_w = inv_w;
-        v3f ndc = {clip.x * inv_w, clip.y * inv_w, clip.z * inv_w};
-        tri[j].depth_ok = ndc.z >= -1.0f && ndc.z <= 1.0f;
-        tri[j].screen =
-            norm_to_screen((v2f){ndc.x, ndc.y}, game->render_w, game->render_h);
-        tri[j].depth = 0.5f * (ndc.z + 1.0f);
-      }
-      if (skip)
-      {
-        continue;
-      }
-
-      if ((tri[0].clip_mask & tri[1].clip_mask & tri[2].clip_mask) != 0)
-      {
-        mc->culled_faces_count++;
-        continue; // frustum culled
-      }
-
-      bool near_in[3] = {tri[0].view_pos.z <= -mc->near_plane,
-                         tri[1].view_pos.z <= -mc->near_plane,
-                         tri[2].view_pos.z <= -mc->near_plane};
-      bool needs_clip = !(near_in[0] && near_in[1] && near_in[2]);
-
-      if (!needs_clip)
-      {
-        if (!tri[0].depth_ok || !tri[1].depth_ok || !tri[2].depth_ok)
-        {
-          continue;
-        }
-        v3f edge1 = v3_sub(tri[1].view_pos, tri[0].view_pos);
-        v3f edge2 = v3_sub(tri[2].view_pos, tri[0].view_pos);
-        v3f normal = v3_cross(edge1, edge2);
-        if (v3_dot(normal, tri[0].view_pos) >= 0.0f)
-        {
-          continue;
-        }
-        VertexPC pv[3] = {
-            {.pos = tri[0].screen, .uv = tri[0].uv, .inv_w = tri[0].inv_w, .depth = tri[0].depth},
-            {.pos = tri[1].screen, .uv = tri[1].uv, .inv_w = tri[1].inv_w, .depth = tri[1].depth},
-            {.pos = tri[2].screen, .uv = tri[2].uv, .inv_w = tri[2].inv_w, .depth = tri[2].depth},
-        };
-
-        if (mc->wireframe)
-        {
-          draw_triangle(game->buffer, game->render_w, game->render_h, pv[0].pos,
-                        pv[1].pos, pv[2].pos, WHITE, WIREFRAME);
-        }
-        else if (is_transparent)
-        {
-          draw_textured_triangle_alpha(game->buffer, game->depth, game->render_w,
-                                       game->render_h, face->tex, pv[0], pv[1],
-                                       pv[2], false);
-        }
-        else
-        {
-          draw_textured_triangle(game->buffer, game->depth, game->render_w,
-                                 game->render_h, face->tex, pv[0], pv[1], pv[2]);
-        }
-        mc->rendered_faces_count++;
-      }
-      else
-      {
-        ClipVert in_poly[4] = {
-            {.view_pos = tri[0].view_pos, .uv = tri[0].uv},
-            {.view_pos = tri[1].view_pos, .uv = tri[1].uv},
-            {.view_pos = tri[2].view_pos, .uv = tri[2].uv},
-        };
-        int in_count = 3;
-        ClipVert out_poly[4];
-        int out_count = 0;
-
-        for (int v = 0; v < in_count; v++)
-        {
-          ClipVert a = in_poly[v];
-          ClipVert b = in_poly[(v + 1) % in_count];
-          bool a_in = a.view_pos.z <= -mc->near_plane;
-          bool b_in = b.view_pos.z <= -mc->near_plane;
-
-          if (a_in && b_in)
-          {
-            out_poly[out_count++] = b;
-          }
-          else if (a_in && !b_in)
-          {
-            float t = (-mc->near_plane - a.view_pos.z) /
-                      (b.view_pos.z - a.view_pos.z);
-            ClipVert inter = {
-                .view_pos = {a.view_pos.x + (b.view_pos.x - a.view_pos.x) * t,
-                             a.view_pos.y + (b.view_pos.y - a.view_pos.y) * t,
-                             -mc->near_plane},
-                .uv = {a.uv.x + (b.uv.x - a.uv.x) * t,
-                       a.uv.y + (b.uv.y - a.uv.y) * t}};
-            out_poly[out_count++] = inter;
-          }
-          else if (!a_in && b_in)
-          {
-            float t = (-mc->near_plane - a.view_pos.z) /
-                      (b.view_pos.z - a.view_pos.z);
-            ClipVert inter = {
-                .view_pos = {a.view_pos.x + (b.view_pos.x - a.view_pos.x) * t,
-                             a.view_pos.y + (b.view_pos.y - a.view_pos.y) * t,
-                             -mc->near_plane},
-                .uv = {a.uv.x + (b.uv.x - a.uv.x) * t,
-                       a.uv.y + (b.uv.y - a.uv.y) * t}};
-            out_poly[out_count++] = inter;
-            out_poly[out_count++] = b;
-          }
-        }
-
-        if (out_count < 3)
-        {
-          continue;
-        }
-
-        int tri_sets[2][3] = {{0, 1, 2}, {0, 2, 3}};
-        int tri_total = (out_count == 4) ? 2 : 1;
-
-        for (int t = 0; t < tri_total; t++)
-        {
-          ClipVert *a = &out_poly[tri_sets[t][0]];
-          ClipVert *b = &out_poly[tri_sets[t][1]];
-          ClipVert *c = &out_poly[tri_sets[t][2]];
-
-          v3f edge1 = v3_sub(b->view_pos, a->view_pos);
-          v3f edge2 = v3_sub(c->view_pos, a->view_pos);
-          v3f normal = v3_cross(edge1, edge2);
-          if (v3_dot(normal, a->view_pos) >= 0.0f)
-          {
-            continue;
-          }
-
-          VertexPC pv[3];
-          int masks[3];
-          if (!project_vertex(a, &proj, game->render_w, game->render_h, &pv[0],
-                              &masks[0]) ||
-              !project_vertex(b, &proj, game->render_w, game->render_h, &pv[1],
-                              &masks[1]) ||
-              !project_vertex(c, &proj, game->render_w, game->render_h, &pv[2],
-                              &masks[2]))
-          {
-            continue;
-          }
-          if ((masks[0] & masks[1] & masks[2]) != 0)
-          {
-            continue;
-          }
-
-          if (mc->wireframe)
-          {
-            draw_triangle(game->buffer, game->render_w, game->render_h, pv[0].pos,
-                          pv[1].pos, pv[2].pos, WHITE, WIREFRAME);
-          }
-          else if (is_transparent)
-          {
-            draw_textured_triangle_alpha(game->buffer, game->depth, game->render_w,
-                                         game->render_h, face->tex, pv[0], pv[1],
-                                         pv[2], false);
-          }
-          else
-          {
-            draw_textured_triangle(game->buffer, game->depth, game->render_w,
-                                   game->render_h, face->tex, pv[0], pv[1], pv[2]);
-          }
-          mc->rendered_faces_count++;
-        }
-      }
+    // Everything after the opaque faces came from a blended mesh group
+    draw_face(mc, render_faces[face_idx], &mv, &proj, face_idx >= opaque_count);
   }
 
-  free(render_faces);
-  free(transparent_faces);
 
   char fps_text[32];
   snprintf(fps_text, sizeof(fps_text), "FPS: %d", (int)(mc->fps + 0.5f));
@@ -1384,9 +1316,38 @@ void mc_frame(Mc *mc, Uint32 now, float dt)
   snprintf(rendered_text, sizeof(rendered_text), "RENDERED FACES: %d", mc->rendered_faces_count);
   draw_text(game->buffer, game->render_w, (v2i){5, 35}, rendered_text, WHITE);
 
+  // Shaded pixels per screen pixel; 1.0 means nothing was shaded twice
+  char overdraw_text[64];
+  snprintf(overdraw_text, sizeof(overdraw_text), "OVERDRAW: %.2f",
+           (double)mc->shaded_pixels_count /
+               (double)(game->render_w * game->render_h));
+  draw_text(game->buffer, game->render_w, (v2i){5, 50}, overdraw_text, WHITE);
+
+  char sections_text[64];
+  snprintf(sections_text, sizeof(sections_text), "SECTIONS: %d%s",
+           mc->visible_sections_count, mc->cave_culling ? "" : " (NO CAVE CULL)");
+  draw_text(game->buffer, game->render_w, (v2i){5, 65}, sections_text, WHITE);
+
+  char mesh_text[64];
+  snprintf(mesh_text, sizeof(mesh_text), "MESH MB: %.1f / %.1f",
+           (double)mesh_pool_used_bytes(&mc->mesh_pool) / (1024.0 * 1024.0),
+           (double)mesh_pool_reserved_bytes(&mc->mesh_pool) / (1024.0 * 1024.0));
+  draw_text(game->buffer, game->render_w, (v2i){5, 80}, mesh_text, WHITE);
+
+  // Chunks holding blocks, and how many blocks and meshes the budgets dropped
+  // and brought back
+  const Residency *res = &mc->residency;
+  char residency_text[96];
+  snprintf(residency_text, sizeof(residency_text),
+           "BLOCKS MB: %.1f CHUNKS: %d EVICT: %d/%d RELOAD: %d/%d",
+           (double)res->voxel_bytes / (1024.0 * 1024.0), res->lru[LRU_VOXEL].count,
+           res->voxel_evicted, res->mesh_evicted, res->voxel_reloaded,
+           res->mesh_reloaded);
+  draw_text(game->buffer, game->render_w, (v2i){5, 95}, residency_text, WHITE);
+
   char block_text[64];
-  snprintf(block_text, sizeof(block_text), "BLOCK: %s", block_name(mc->selected_block));
-  draw_text(game->buffer, game->render_w, (v2i){5, 50}, block_text, WHITE);
+  snprintf(block_text, sizeof(block_text), "BLOCK: %s", block_info[mc->selected_block].name);
+  draw_text(game->buffer, game->render_w, (v2i){5, 110}, block_text, WHITE);
 
   draw_block_preview(mc);
   draw_inventory(mc);
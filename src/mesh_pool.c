@@ -0,0 +1,177 @@
+#include "mesh_pool.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+// Pages are carved from slabs, so re-meshing only moves pages between
+// meshes and free lists and the heap never fragments. A mesh wastes at most
+// the unused tail of its last page. New pages come from the fullest slab
+// with room, which leaves the others to empty out for mesh_pool_trim.
+static MeshSlab *slab_new(MeshPool *pool)
+{
+  if (pool->slab_count == pool->slab_cap)
+  {
+    int new_cap = pool->slab_cap ? pool->slab_cap * 2 : 16;
+    MeshSlab **grown = realloc(pool->slabs, (size_t)new_cap * sizeof(MeshSlab *));
+    if (!grown)
+    {
+      return NULL;
+    }
+    pool->slabs = grown;
+    pool->slab_cap = new_cap;
+  }
+  MeshSlab *slab = malloc(sizeof(MeshSlab));
+  if (!slab)
+  {
+    return NULL;
+  }
+  slab->free_pages = NULL;
+  slab->pages_used = 0;
+  for (int i = MESH_SLAB_PAGES - 1; i >= 0; i--)
+  {
+    slab->pages[i].next = slab->free_pages;
+    slab->free_pages = &slab->pages[i];
+  }
+  int at = pool->slab_count;
+  while (at > 0 && (uintptr_t)pool->slabs[at - 1] > (uintptr_t)slab)
+  {
+    pool->slabs[at] = pool->slabs[at - 1];
+    at--;
+  }
+  pool->slabs[at] = slab;
+  pool->slab_count++;
+  pool->pages_reserved += MESH_SLAB_PAGES;
+  return slab;
+}
+
+// The slab a page was carved from: the last one starting at or below it
+static MeshSlab *slab_of(const MeshPool *pool, const MeshPage *page)
+{
+  int lo = 0;
+  int hi = pool->slab_count - 1;
+  while (lo < hi)
+  {
+    int mid = (lo + hi + 1) / 2;
+    if ((uintptr_t)pool->slabs[mid] <= (uintptr_t)page)
+    {
+      lo = mid;
+    }
+    else
+    {
+      hi = mid - 1;
+    }
+  }
+  return pool->slabs[lo];
+}
+
+static MeshPage *page_alloc(MeshPool *pool)
+{
+  if (!pool->current || !pool->current->free_pages)
+  {
+    pool->current = NULL;
+    for (int i = 0; i < pool->slab_count; i++)
+    {
+      MeshSlab *slab = pool->slabs[i];
+      if (slab->free_pages &&
+          (!pool->current || slab->pages_used > pool->current->pages_used))
+      {
+        pool->current = slab;
+      }
+    }
+    if (!pool->current)
+    {
+      if (mesh_pool_full(pool))
+      {
+        return NULL;
+      }
+      pool->current = slab_new(pool);
+      if (!pool->current)
+      {
+        return NULL;
+      }
+    }
+  }
+  MeshSlab *slab = pool->current;
+  MeshPage *page = slab->free_pages;
+  slab->free_pages = page->next;
+  slab->pages_used++;
+  pool->pages_used++;
+  return page;
+}
+
+static void page_free(MeshPool *pool, MeshPage *page)
+{
+  MeshSlab *slab = slab_of(pool, page);
+  page->next = slab->free_pages;
+  slab->free_pages = page;
+  slab->pages_used--;
+  pool->pages_used--;
+}
+
+Face *chunk_mesh_push(MeshPool *pool, ChunkMesh *mesh)
+{
+  if (mesh->face_count == mesh->page_count * MESH_PAGE_FACES)
+  {
+    if (mesh->page_count == mesh->page_cap)
+    {
+      int new_cap = mesh->page_cap ? mesh->page_cap * 2 : 4;
+      MeshPage **grown = realloc(mesh->pages, (size_t)new_cap * sizeof(MeshPage *));
+      if (!grown)
+      {
+        return NULL;
+      }
+      mesh->pages = grown;
+      mesh->page_cap = new_cap;
+    }
+    MeshPage *page = page_alloc(pool);
+    if (!page)
+    {
+      return NULL;
+    }
+    mesh->pages[mesh->page_count++] = page;
+  }
+  pool->faces_used++;
+  return chunk_mesh_face(mesh, mesh->face_count++);
+}
+
+void chunk_mesh_clear(MeshPool *pool, ChunkMesh *mesh)
+{
+  for (int i = 0; i < mesh->page_count; i++)
+  {
+    page_free(pool, mesh->pages[i]);
+  }
+  pool->faces_used -= (size_t)mesh->face_count;
+  mesh->page_count = 0;
+  mesh->face_count = 0;
+}
+
+// Gives the slabs with no page in use back to the heap
+void mesh_pool_trim(MeshPool *pool)
+{
+  int kept = 0;
+  for (int i = 0; i < pool->slab_count; i++)
+  {
+    MeshSlab *slab = pool->slabs[i];
+    if (slab->pages_used > 0)
+    {
+      pool->slabs[kept++] = slab;
+      continue;
+    }
+    if (slab == pool->current)
+    {
+      pool->current = NULL;
+    }
+    free(slab);
+    pool->pages_reserved -= MESH_SLAB_PAGES;
+  }
+  pool->slab_count = kept;
+}
+
+void mesh_pool_free(MeshPool *pool)
+{
+  for (int i = 0; i < pool->slab_count; i++)
+  {
+    free(pool->slabs[i]);
+  }
+  free(pool->slabs);
+  *pool = (MeshPool){0};
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "mc.h"
+#include <stddef.h>
+
+Face *chunk_mesh_push(MeshPool *pool, ChunkMesh *mesh);
+void chunk_mesh_clear(MeshPool *pool, ChunkMesh *mesh);
+void mesh_pool_trim(MeshPool *pool);
+void mesh_pool_free(MeshPool *pool);
+
+static inline Face *chunk_mesh_face(const ChunkMesh *mesh, int i)
+{
+  return &mesh->pages[i / MESH_PAGE_FACES]->faces[i % MESH_PAGE_FACES];
+}
+
+static inline size_t mesh_pool_used_bytes(const MeshPool *pool)
+{
+  return pool->faces_used * sizeof(Face);
+}
+
+static inline size_t mesh_pool_reserved_bytes(const MeshPool *pool)
+{
+  return pool->pages_reserved * sizeof(MeshPage);
+}
+
+// Whether no page is free and byte_limit keeps another slab from being added
+static inline bool mesh_pool_full(const MeshPool *pool)
+{
+  return pool->byte_limit && pool->slab_count > 0 &&
+         pool->pages_used == pool->pages_reserved &&
+         mesh_pool_reserved_bytes(pool) + MESH_SLAB_PAGES * sizeof(MeshPage) >
+             pool->byte_limit;
+}
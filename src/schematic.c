@@ -0,0 +1,365 @@
+#include "schematic.h"
+#include "blocks.h"
+#include "world.h"
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+
+// Schematic files are little-endian:
+//   "MCSC", u8 version
+//   u16 w, h, d, then u16 ox, oy, oz, the anchor cell
+//   u8 palette count, then per entry a u8 name length and the block name
+//   runs covering all w * h * d cells: LEB128 length, u8 palette index
+// Cells are ordered like a Structure's. Blocks are stored by name, so files
+// keep working when block types are added or reordered.
+#define SCHEMATIC_MAGIC "MCSC"
+#define SCHEMATIC_VERSION 1
+
+static void put_u16(FILE *f, int v)
+{
+  fputc(v & 0xFF, f);
+  fputc((v >> 8) & 0xFF, f);
+}
+
+static bool get_u16(FILE *f, int *v)
+{
+  int lo = fgetc(f);
+  int hi = fgetc(f);
+  if (lo == EOF || hi == EOF)
+  {
+    return false;
+  }
+  *v = lo | (hi << 8);
+  return true;
+}
+
+static void flush_run(SchematicWriter *w)
+{
+  u32 n = w->run_length;
+  while (n >= 0x80)
+  {
+    fputc((int)(n & 0x7F) | 0x80, w->file);
+    n >>= 7;
+  }
+  fputc((int)n, w->file);
+  fputc(w->run_type, w->file);
+  w->run_length = 0;
+}
+
+// The palette is the whole block registry, so runs can be written as the
+// cells arrive without a first pass to find the types in use.
+bool schematic_writer_open(SchematicWriter *w, const char *path, int sw, int sh,
+                           int sd, int ox, int oy, int oz)
+{
+  *w = (SchematicWriter){0};
+  if (sw <= 0 || sh <= 0 || sd <= 0 || sw > 0xFFFF || sh > 0xFFFF ||
+      sd > 0xFFFF || (uint64_t)sw * sh * sd > UINT32_MAX || ox < 0 ||
+      oy < 0 || oz < 0 || ox >= sw || oy >= sh || oz >= sd)
+  {
+    return false;
+  }
+  w->file = fopen(path, "wb");
+  if (!w->file)
+  {
+    return false;
+  }
+  w->remaining = (u32)sw * (u32)sh * (u32)sd;
+  fwrite(SCHEMATIC_MAGIC, 1, 4, w->file);
+  fputc(SCHEMATIC_VERSION, w->file);
+  put_u16(w->file, sw);
+  put_u16(w->file, sh);
+  put_u16(w->file, sd);
+  put_u16(w->file, ox);
+  put_u16(w->file, oy);
+  put_u16(w->file, oz);
+  fputc(BLOCK_COUNT, w->file);
+  for (int t = 0; t < BLOCK_COUNT; t++)
+  {
+    size_t len = strlen(block_info[t].name);
+    fputc((int)len, w->file);
+    fwrite(block_info[t].name, 1, len, w->file);
+  }
+  return true;
+}
+
+void schematic_writer_put(SchematicWriter *w, BlockType t)
+{
+  if (w->remaining == 0)
+  {
+    w->failed = true;
+    return;
+  }
+  w->remaining--;
+  if (w->run_length > 0 && t == w->run_type)
+  {
+    w->run_length++;
+    return;
+  }
+  if (w->run_length > 0)
+  {
+    flush_run(w);
+  }
+  w->run_type = t;
+  w->run_length = 1;
+}
+
+// False if the cells put did not fill the schematic or the file could not
+// be written.
+bool schematic_writer_close(SchematicWriter *w)
+{
+  if (w->run_length > 0)
+  {
+    flush_run(w);
+  }
+  bool ok = !w->failed && w->remaining == 0 && !ferror(w->file);
+  if (fclose(w->file) != 0)
+  {
+    ok = false;
+  }
+  w->file = NULL;
+  return ok;
+}
+
+// Reads the header and palette. Names this build does not know read as air.
+bool schematic_reader_open(SchematicReader *r, const char *path)
+{
+  *r = (SchematicReader){0};
+  r->file = fopen(path, "rb");
+  if (!r->file)
+  {
+    return false;
+  }
+  char magic[4];
+  int count = 0;
+  if (fread(magic, 1, 4, r->file) != 4 || memcmp(magic, SCHEMATIC_MAGIC, 4) != 0 ||
+      fgetc(r->file) != SCHEMATIC_VERSION ||
+      !get_u16(r->file, &r->w) || !get_u16(r->file, &r->h) ||
+      !get_u16(r->file, &r->d) || !get_u16(r->file, &r->ox) ||
+      !get_u16(r->file, &r->oy) || !get_u16(r->file, &r->oz) ||
+      (uint64_t)r->w * r->h * r->d > UINT32_MAX ||
+      (count = fgetc(r->file)) == EOF)
+  {
+    schematic_reader_close(r);
+    return false;
+  }
+  r->palette_count = count;
+  for (int i = 0; i < count; i++)
+  {
+    char name[256];
+    int len = fgetc(r->file);
+    if (len == EOF || fread(name, 1, (size_t)len, r->file) != (size_t)len)
+    {
+      schematic_reader_close(r);
+      return false;
+    }
+    name[len] = '\0';
+    r->palette[i] = BLOCK_AIR;
+    for (int t = 0; t < BLOCK_COUNT; t++)
+    {
+      if (strcmp(block_info[t].name, name) == 0)
+      {
+        r->palette[i] = (BlockType)t;
+        break;
+      }
+    }
+  }
+  r->remaining = (u32)r->w * (u32)r->h * (u32)r->d;
+  return true;
+}
+
+// Length of the next run, with its block in *t; 0 once every cell has been
+// read or the file turned out to be bad (see failed).
+u32 schematic_reader_run(SchematicReader *r, BlockType *t)
+{
+  if (r->remaining == 0 || r->failed)
+  {
+    return 0;
+  }
+  u32 n = 0;
+  for (int shift = 0;; shift += 7)
+  {
+    int c = fgetc(r->file);
+    if (c == EOF || shift > 28)
+    {
+      r->failed = true;
+      return 0;
+    }
+    n |= (u32)(c & 0x7F) << shift;
+    if (!(c & 0x80))
+    {
+      break;
+    }
+  }
+  int index = fgetc(r->file);
+  if (n == 0 || n > r->remaining || index == EOF || index >= r->palette_count)
+  {
+    r->failed = true;
+    return 0;
+  }
+  r->remaining -= n;
+  *t = r->palette[index];
+  return n;
+}
+
+// False if the file ended early or was corrupt.
+bool schematic_reader_close(SchematicReader *r)
+{
+  bool ok = !r->failed && r->remaining == 0;
+  if (r->file)
+  {
+    fclose(r->file);
+    r->file = NULL;
+  }
+  return ok;
+}
+
+static int save_worker(void *data)
+{
+  SchematicSave *save = data;
+  const BlockBox box = save->box;
+  for (int y = box.y0; y <= box.y1; y++)
+  {
+    for (int z = box.z0; z <= box.z1; z++)
+    {
+      for (int x = box.x0; x <= box.x1; x++)
+      {
+        schematic_writer_put(&save->writer, snapshot_block_get(&save->snap, x, y, z));
+      }
+    }
+  }
+  save->ok = schematic_writer_close(&save->writer);
+  chunk_snapshot_release(&save->snap);
+  return 0;
+}
+
+// Starts writing the blocks in box as they are now, with the anchor cell at
+// world block (ax, ay, az), which must lie inside the box. Chunks under the
+// box that are not resident are loaded or generated first. The world may be
+// edited while the file is written; schematic_save_finish waits for it.
+// False if nothing was started.
+bool schematic_save_start(Mc *mc, SchematicSave *save, const char *path,
+                          BlockBox box, int ax, int ay, int az)
+{
+  *save = (SchematicSave){.box = box};
+  if (!region_load(mc, box) || !chunk_snapshot_take(mc, box, &save->snap))
+  {
+    return false;
+  }
+  if (!schematic_writer_open(&save->writer, path, box.x1 - box.x0 + 1,
+                             box.y1 - box.y0 + 1, box.z1 - box.z0 + 1,
+                             ax - box.x0, ay - box.y0, az - box.z0))
+  {
+    chunk_snapshot_release(&save->snap);
+    return false;
+  }
+  save->thread = SDL_CreateThread(save_worker, "schematic", save);
+  if (!save->thread)
+  {
+    save_worker(save);
+  }
+  return true;
+}
+
+// Waits for the save to be written. False if the file could not be written.
+bool schematic_save_finish(SchematicSave *save)
+{
+  if (save->thread)
+  {
+    SDL_WaitThread(save->thread, NULL);
+    save->thread = NULL;
+  }
+  return save->ok;
+}
+
+// Writes the blocks in box, with the anchor cell at world block (ax, ay, az),
+// which must lie inside the box, and waits for the file.
+bool schematic_save(Mc *mc, const char *path, BlockBox box, int ax, int ay,
+                    int az)
+{
+  SchematicSave save;
+  return schematic_save_start(mc, &save, path, box, ax, ay, az) &&
+         schematic_save_finish(&save);
+}
+
+// Pastes a schematic file with its anchor at (x, y, z), decoding the runs
+// straight into the chunks as rows of blocks. The cells are mirrored along x first if asked,
+// then turned by quarter turns about the anchor, each taking +x to +z. Air
+// cells leave the world untouched, as with region_stamp. Every chunk under
+// the pasted box is loaded or generated before anything is written. Returns
+// the number of chunks touched, or -1 if the file could not be read, the
+// box could not be loaded (nothing is written then) or the file broke off
+// part way (the cells before the break are still written).
+int schematic_paste(Mc *mc, const char *path, int x, int y, int z, int turns,
+                    bool mirror)
+{
+  SchematicReader r;
+  if (!schematic_reader_open(&r, path))
+  {
+    return -1;
+  }
+  // World step of one cell along the schematic's x and z axes
+  int xx = mirror ? -1 : 1, xz = 0;
+  int zx = 0, zz = 1;
+  for (int i = 0; i < (turns & 3); i++)
+  {
+    int t = xx;
+    xx = -xz;
+    xz = t;
+    t = zx;
+    zx = -zz;
+    zz = t;
+  }
+  // The pasted box is spanned by the turned corners of the footprint
+  BlockBox box = {INT_MAX, y - r.oy, INT_MAX, INT_MIN, y - r.oy + r.h - 1, INT_MIN};
+  for (int corner = 0; corner < 4; corner++)
+  {
+    int dx = ((corner & 1) ? r.w - 1 : 0) - r.ox;
+    int dz = ((corner & 2) ? r.d - 1 : 0) - r.oz;
+    int wx = x + dx * xx + dz * zx;
+    int wz = z + dx * xz + dz * zz;
+    box.x0 = (wx < box.x0) ? wx : box.x0;
+    box.x1 = (wx > box.x1) ? wx : box.x1;
+    box.z0 = (wz < box.z0) ? wz : box.z0;
+    box.z1 = (wz > box.z1) ? wz : box.z1;
+  }
+  if (!region_load(mc, box))
+  {
+    schematic_reader_close(&r);
+    return -1;
+  }
+  EditBatch batch = {0};
+  u32 cell = 0;
+  u32 n;
+  BlockType t;
+  while ((n = schematic_reader_run(&r, &t)) > 0)
+  {
+    if (t == BLOCK_AIR)
+    {
+      cell += n;
+      continue;
+    }
+    int sx = (int)(cell % (u32)r.w);
+    int sz = (int)(cell / (u32)r.w % (u32)r.d);
+    int sy = (int)(cell / ((u32)r.w * (u32)r.d));
+    cell += n;
+    // A run is written one schematic row at a time, each a straight row of
+    // blocks along the turned x axis
+    while (n > 0)
+    {
+      int count = ((u32)(r.w - sx) < n) ? r.w - sx : (int)n;
+      int dx = sx - r.ox, dz = sz - r.oz;
+      edit_batch_row(mc, &batch, x + dx * xx + dz * zx, y + sy - r.oy,
+                     z + dx * xz + dz * zz, xx, xz, count, t);
+      n -= (u32)count;
+      sx = 0;
+      if (++sz == r.d)
+      {
+        sz = 0;
+        sy++;
+      }
+    }
+  }
+  bool ok = schematic_reader_close(&r);
+  int touched = edit_batch_finish(mc, &batch);
+  return ok ? touched : -1;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "mc.h"
+#include <stdbool.h>
+#include <stdio.h>
+
+// Streams cells in y, z, x order (x fastest) into a schematic file, merging
+// equal neighbours into runs as they arrive. Exactly w * h * d cells must be
+// put before closing.
+typedef struct
+{
+  FILE *file;
+  BlockType run_type;
+  u32 run_length;
+  u32 remaining; // cells still to put
+  bool failed;
+} SchematicWriter;
+
+// Streams the runs of a schematic file back out, in the order they were put
+typedef struct
+{
+  FILE *file;
+  int w, h, d;
+  int ox, oy, oz; // anchor cell
+  BlockType palette[256];
+  int palette_count;
+  u32 remaining; // cells in runs not read yet
+  bool failed;
+} SchematicReader;
+
+// A save in progress: the blocks were captured in a snapshot when it started
+// and are written out on a thread of its own
+typedef struct
+{
+  ChunkSnapshot snap;
+  SchematicWriter writer;
+  BlockBox box;
+  SDL_Thread *thread; // NULL once finished, or if it ran on the caller's
+  bool ok;
+} SchematicSave;
+
+bool schematic_writer_open(SchematicWriter *w, const char *path, int sw, int sh,
+                           int sd, int ox, int oy, int oz);
+void schematic_writer_put(SchematicWriter *w, BlockType t);
+bool schematic_writer_close(SchematicWriter *w);
+bool schematic_reader_open(SchematicReader *r, const char *path);
+u32 schematic_reader_run(SchematicReader *r, BlockType *t);
+bool schematic_reader_close(SchematicReader *r);
+bool schematic_save_start(Mc *mc, SchematicSave *save, const char *path,
+                          BlockBox box, int ax, int ay, int az);
+bool schematic_save_finish(SchematicSave *save);
+bool schematic_save(Mc *mc, const char *path, BlockBox box, int ax, int ay,
+                    int az);
+int schematic_paste(Mc *mc, const char *path, int x, int y, int z, int turns,
+                    bool mirror);
@@ -1,247 +1,2614 @@
 #include "world.h"
+#include "blocks.h"
 #include "colors.h"
+#include "far_terrain.h"
+#include "gen_pool.h"
+#include "mesh_pool.h"
+#include "chunk_map.h"
+#include "worldgen.h"
 #include "math.h"
+#include <limits.h>
 #include <math.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 
-static inline int mc_height(const Mc *mc)
+static inline int floor_div(int a, int b)
 {
-  return mc->y_max - mc->y_min + 1;
+  return (a >= 0) ? a / b : -((-a + b - 1) / b);
 }
 
-static inline int block_index(const Mc *mc, int x, int y, int z)
+static inline int floor_mod(int a, int b)
 {
-  return ((y - mc->y_min) * mc->size_z + z) * mc->size_x + x;
+  return a - floor_div(a, b) * b;
 }
 
-static inline bool block_is_opaque(BlockType t)
+#define SECTION_VOLUME (SECTION_SIZE * CHUNK_SIZE * CHUNK_SIZE)
+
+// Block storage of a section with its reference count in front. The chunk
+// owns one reference and every snapshot that can see the section another.
+typedef struct
+{
+  SDL_atomic_t refs;
+  BlockType blocks[SECTION_VOLUME];
+} SectionBlocks;
+
+static inline SectionBlocks *section_store(const BlockType *blocks)
+{
+  return (SectionBlocks *)((char *)blocks - offsetof(SectionBlocks, blocks));
+}
+
+// All-air section storage with a single reference.
+static BlockType *section_blocks_new(void)
+{
+  SectionBlocks *store = calloc(1, sizeof(SectionBlocks));
+  if (!store)
+  {
+    return NULL;
+  }
+  SDL_AtomicSet(&store->refs, 1);
+  return store->blocks;
+}
+
+void section_blocks_retain(const BlockType *blocks)
+{
+  SDL_AtomicIncRef(&section_store(blocks)->refs);
+}
+
+// Drops a reference, freeing the storage with the last one. Any thread.
+void section_blocks_release(const BlockType *blocks)
+{
+  if (blocks && SDL_AtomicDecRef(&section_store(blocks)->refs))
+  {
+    free(section_store(blocks));
+  }
+}
+
+static inline ChunkSection *chunk_section(const Chunk *chunk, int sy)
+{
+  int i = sy - chunk->section_min;
+  return (i >= 0 && i < chunk->section_count) ? &chunk->sections[i] : NULL;
+}
+
+static inline bool section_empty(const ChunkSection *section)
+{
+  return !section || (!section->blocks && !section->runs);
+}
+
+static inline const u8 *section_run_types(const ChunkSection *section)
+{
+  return (const u8 *)(section->runs + section->run_count);
+}
+
+// Run of a packed section holding storage index i
+static int section_run_at(const ChunkSection *section, int i)
 {
-  return t != BLOCK_AIR && t != BLOCK_GLASS && t != BLOCK_LEAVES;
+  int lo = 0, hi = section->run_count - 1;
+  while (lo < hi)
+  {
+    int mid = (lo + hi) / 2;
+    if (section->runs[mid] <= i)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
 }
 
-static void grow_y(Mc *mc, int new_y)
+// Block at storage index i of a section, read in place if it is packed.
+static BlockType section_get(const ChunkSection *section, int i)
 {
-  int new_y_min = (new_y < mc->y_min) ? new_y : mc->y_min;
-  int new_y_max = (new_y > mc->y_max) ? new_y : mc->y_max;
-  int new_height = new_y_max - new_y_min + 1;
+  if (section->blocks)
+  {
+    return section->blocks[i];
+  }
+  if (!section->runs)
+  {
+    return BLOCK_AIR;
+  }
+  return (BlockType)section_run_types(section)[section_run_at(section, i)];
+}
 
-  size_t new_count = (size_t)mc->size_x * (size_t)new_height * (size_t)mc->size_z;
-  BlockType *new_blocks = malloc(new_count * sizeof(BlockType));
-  if (!new_blocks)
+// Copies count blocks of the x row at (lx, ly, lz) out of a section, walking
+// the runs in place if it is packed.
+static void section_row_get(const ChunkSection *section, int lx, int ly, int lz,
+                            int count, BlockType *out)
+{
+  if (section->blocks)
+  {
+    section_read_row(section->blocks, lx, ly, lz, count, out);
+    return;
+  }
+  if (!section->runs)
   {
+    memset(out, 0, (size_t)count * sizeof(BlockType));
     return;
   }
-  for (size_t i = 0; i < new_count; i++)
+  const u8 *types = section_run_types(section);
+  int i = section_block_index(lx, ly, lz);
+  int r = section_run_at(section, i);
+  // Indices only grow along x in either layout, so the runs are walked once
+  for (int k = 0; k < count; k++, i = section_index_inc(i, SECTION_X_BITS))
   {
-    new_blocks[i] = BLOCK_AIR;
+    while (section->runs[r] <= i)
+    {
+      r++;
+    }
+    out[k] = (BlockType)types[r];
   }
+}
 
-  for (int y = mc->y_min; y <= mc->y_max; y++)
+// Swaps a section's blocks for their runs in storage order. Sections that
+// would not shrink to half are left alone, as they are if memory is short.
+static void section_pack(ChunkSection *section)
+{
+  const BlockType *blocks = section->blocks;
+  if (!blocks)
+  {
+    return;
+  }
+  int count = 1;
+  for (int i = 1; i < SECTION_VOLUME; i++)
   {
-    int dst_y = y - new_y_min;
-    int src_y = y - mc->y_min;
-    size_t src_offset = (size_t)src_y * (size_t)mc->size_z * (size_t)mc->size_x;
-    size_t dst_offset = (size_t)dst_y * (size_t)mc->size_z * (size_t)mc->size_x;
-    memcpy(new_blocks + dst_offset, mc->blocks + src_offset,
-           (size_t)mc->size_z * (size_t)mc->size_x * sizeof(BlockType));
+    count += blocks[i] != blocks[i - 1];
   }
+  size_t size = (size_t)count * (sizeof(u16) + 1);
+  u16 *runs = (size * 2 < sizeof(SectionBlocks)) ? malloc(size) : NULL;
+  if (!runs)
+  {
+    return;
+  }
+  u8 *types = (u8 *)(runs + count);
+  for (int i = 1, r = 0; i <= SECTION_VOLUME; i++)
+  {
+    if (i == SECTION_VOLUME || blocks[i] != blocks[i - 1])
+    {
+      runs[r] = (u16)i;
+      types[r++] = (u8)blocks[i - 1];
+    }
+  }
+  section_blocks_release(blocks);
+  section->blocks = NULL;
+  section->runs = runs;
+  section->run_count = count;
+}
 
-  free(mc->blocks);
-  mc->blocks = new_blocks;
-  mc->y_min = new_y_min;
-  mc->y_max = new_y_max;
-  mc->mesh_dirty = true;
+static bool section_unpack(ChunkSection *section)
+{
+  if (!section->runs)
+  {
+    return true;
+  }
+  BlockType *blocks = section_blocks_new();
+  if (!blocks)
+  {
+    return false;
+  }
+  const u8 *types = section_run_types(section);
+  for (int r = 0, i = 0; r < section->run_count; r++)
+  {
+    for (; i < section->runs[r]; i++)
+    {
+      blocks[i] = (BlockType)types[r];
+    }
+  }
+  free(section->runs);
+  section->runs = NULL;
+  section->run_count = 0;
+  section->blocks = blocks;
+  return true;
 }
 
-BlockType block_get(const Mc *mc, int x, int y, int z)
+static void chunk_pack(Chunk *chunk)
 {
-  if (x < 0 || x >= mc->size_x || y < mc->y_min || y > mc->y_max || z < 0 ||
-      z >= mc->size_z)
+  for (int i = 0; i < chunk->section_count; i++)
   {
-    return BLOCK_AIR;
+    section_pack(&chunk->sections[i]);
   }
-  return mc->blocks[block_index(mc, x, y, z)];
+  chunk->packed = true;
 }
 
-void block_set(Mc *mc, int x, int y, int z, BlockType t)
+static bool chunk_unpack(Chunk *chunk)
+{
+  for (int i = 0; chunk->packed && i < chunk->section_count; i++)
+  {
+    if (!section_unpack(&chunk->sections[i]))
+    {
+      return false;
+    }
+  }
+  chunk->packed = false;
+  return true;
+}
+
+// The chunk struct with its heightmaps, section table, section data and
+// mesh tables; only the mesh pages count against the mesh budget instead
+static size_t chunk_voxel_bytes(const Chunk *chunk)
+{
+  size_t bytes = sizeof(Chunk) + (size_t)chunk->section_count * sizeof(ChunkSection) +
+                 (size_t)chunk->mesh.section_count * sizeof(SectionMesh) +
+                 (size_t)chunk->mesh.page_cap * sizeof(MeshPage *);
+  for (int i = 0; i < chunk->section_count; i++)
+  {
+    const ChunkSection *section = &chunk->sections[i];
+    bytes += section->blocks ? sizeof(SectionBlocks)
+                             : (size_t)section->run_count * (sizeof(u16) + 1);
+  }
+  return bytes;
+}
+
+static void lru_remove(Mc *mc, Chunk *chunk, int list)
 {
-  if (x < 0 || x >= mc->size_x || z < 0 || z >= mc->size_z)
+  ChunkList *l = &mc->residency.lru[list];
+  ChunkLink *link = &chunk->lru[list];
+  if (!link->linked)
   {
     return;
   }
-  if (y < mc->y_min || y > mc->y_max)
+  if (link->prev)
+    link->prev->lru[list].next = link->next;
+  else
+    l->head = link->next;
+  if (link->next)
+    link->next->lru[list].prev = link->prev;
+  else
+    l->tail = link->prev;
+  *link = (ChunkLink){0};
+  l->count--;
+}
+
+// Moves the chunk to the front of an LRU list, adding it if needed
+static void lru_push_front(Mc *mc, Chunk *chunk, int list)
+{
+  ChunkList *l = &mc->residency.lru[list];
+  if (l->head == chunk)
+  {
+    return;
+  }
+  lru_remove(mc, chunk, list);
+  chunk->lru[list] = (ChunkLink){NULL, l->head, true};
+  if (l->head)
+    l->head->lru[list].prev = chunk;
+  else
+    l->tail = chunk;
+  l->head = chunk;
+  l->count++;
+}
+
+// Brings Residency.voxel_bytes up to date after the chunk's blocks changed
+// size, so the budget never has to walk the map.
+static void chunk_account(Mc *mc, Chunk *chunk)
+{
+  size_t bytes = chunk_voxel_bytes(chunk);
+  mc->residency.voxel_bytes = mc->residency.voxel_bytes - chunk->voxel_bytes + bytes;
+  chunk->voxel_bytes = bytes;
+}
+
+// Marks the chunk's blocks as just used
+static void chunk_touch(Mc *mc, Chunk *chunk)
+{
+  chunk->used_ticks = mc->world_ticks;
+  if (!chunk->unloaded)
+  {
+    lru_push_front(mc, chunk, LRU_VOXEL);
+  }
+}
+
+// Spill records: int section_min and section_count, then per section a u8
+// kind, its u16 solid count and, for SPILL_RUNS, a u16 run count and the
+// runs as stored, or for SPILL_RAW one byte per block.
+enum
+{
+  SPILL_EMPTY,
+  SPILL_RUNS,
+  SPILL_RAW
+};
+
+// Hands a chunk's spill slot back for reuse, merged with free neighbours;
+// one that ends the file shortens it instead.
+static void spill_slot_release(Residency *res, long offset, size_t cap)
+{
+  for (int i = 0; i < res->spill_free_count;)
   {
-    grow_y(mc, y);
+    SpillSlot *slot = &res->spill_free[i];
+    if (slot->offset + (long)slot->cap == offset ||
+        offset + (long)cap == slot->offset)
+    {
+      if (slot->offset < offset)
+      {
+        offset = slot->offset;
+      }
+      cap += slot->cap;
+      *slot = res->spill_free[--res->spill_free_count];
+      continue;
+    }
+    i++;
   }
-  if (y < mc->y_min || y > mc->y_max)
+  if (offset + (long)cap == res->spill_end)
   {
+    res->spill_end = offset;
     return;
   }
-  mc->blocks[block_index(mc, x, y, z)] = t;
-  mc->mesh_dirty = true;
+  if (res->spill_free_count == res->spill_free_cap)
+  {
+    int new_cap = res->spill_free_cap ? res->spill_free_cap * 2 : 16;
+    SpillSlot *grown = realloc(res->spill_free, (size_t)new_cap * sizeof(SpillSlot));
+    if (!grown)
+    {
+      return; // the space is lost until the file is closed
+    }
+    res->spill_free = grown;
+    res->spill_free_cap = new_cap;
+  }
+  res->spill_free[res->spill_free_count++] = (SpillSlot){offset, cap};
+}
+
+// Takes the smallest free spill slot that holds size bytes, or appends one.
+// The slot may be larger than asked for; all of it stays with the chunk.
+static SpillSlot spill_slot_take(Residency *res, size_t size)
+{
+  int best = -1;
+  for (int i = 0; i < res->spill_free_count; i++)
+  {
+    if (res->spill_free[i].cap >= size &&
+        (best < 0 || res->spill_free[i].cap < res->spill_free[best].cap))
+    {
+      best = i;
+    }
+  }
+  if (best < 0)
+  {
+    SpillSlot slot = {res->spill_end, size};
+    res->spill_end += (long)size;
+    return slot;
+  }
+  SpillSlot slot = res->spill_free[best];
+  res->spill_free[best] = res->spill_free[--res->spill_free_count];
+  return slot;
+}
+
+// Writes the blocks of a modified chunk to the spill file, in its old slot
+// if they still fit and otherwise in a free or new one, giving the old slot
+// back. False if the file could not be opened or written.
+static bool chunk_spill(Mc *mc, Chunk *chunk)
+{
+  Residency *res = &mc->residency;
+  if (!res->spill && !(res->spill = tmpfile()))
+  {
+    return false;
+  }
+  size_t size = 2 * sizeof(int);
+  for (int i = 0; i < chunk->section_count; i++)
+  {
+    const ChunkSection *section = &chunk->sections[i];
+    size += 1 + sizeof(u16);
+    if (section->runs)
+      size += sizeof(u16) + (size_t)section->run_count * (sizeof(u16) + 1);
+    else if (section->blocks)
+      size += SECTION_VOLUME;
+  }
+  u8 *record = malloc(size);
+  if (!record)
+  {
+    return false;
+  }
+  u8 *p = record;
+  memcpy(p, &chunk->section_min, sizeof(int));
+  memcpy(p + sizeof(int), &chunk->section_count, sizeof(int));
+  p += 2 * sizeof(int);
+  for (int i = 0; i < chunk->section_count; i++)
+  {
+    const ChunkSection *section = &chunk->sections[i];
+    u16 solid = (u16)section->solid_count;
+    *p++ = section->runs ? SPILL_RUNS : section->blocks ? SPILL_RAW : SPILL_EMPTY;
+    memcpy(p, &solid, sizeof(u16));
+    p += sizeof(u16);
+    if (section->runs)
+    {
+      u16 count = (u16)section->run_count;
+      size_t bytes = (size_t)count * (sizeof(u16) + 1);
+      memcpy(p, &count, sizeof(u16));
+      memcpy(p + sizeof(u16), section->runs, bytes);
+      p += sizeof(u16) + bytes;
+    }
+    else if (section->blocks)
+    {
+      for (int k = 0; k < SECTION_VOLUME; k++)
+      {
+        *p++ = (u8)section->blocks[k];
+      }
+    }
+  }
+  SpillSlot slot = {chunk->spill_offset, chunk->spill_cap};
+  if (size > slot.cap)
+  {
+    slot = spill_slot_take(res, size);
+  }
+  bool ok = fseek(res->spill, slot.offset, SEEK_SET) == 0 &&
+            fwrite(record, 1, size, res->spill) == size;
+  free(record);
+  if (slot.offset == chunk->spill_offset && slot.cap == chunk->spill_cap)
+  {
+    return ok;
+  }
+  if (ok)
+  {
+    // The old slot goes back once the record is safely in the new one
+    if (chunk->spill_cap > 0)
+    {
+      spill_slot_release(res, chunk->spill_offset, chunk->spill_cap);
+    }
+    chunk->spill_offset = slot.offset;
+    chunk->spill_cap = slot.cap;
+  }
+  else
+  {
+    spill_slot_release(res, slot.offset, slot.cap);
+  }
+  return ok;
+}
+
+// Reads back what chunk_spill wrote into an unloaded chunk. The sections
+// come back packed as they went out.
+static bool chunk_unspill(Mc *mc, Chunk *chunk)
+{
+  FILE *f = mc->residency.spill;
+  int header[2];
+  if (!f || fseek(f, chunk->spill_offset, SEEK_SET) != 0 ||
+      fread(header, sizeof(int), 2, f) != 2 || header[1] < 0)
+  {
+    return false;
+  }
+  ChunkSection *sections = calloc((size_t)header[1] + 1, sizeof(ChunkSection));
+  if (!sections)
+  {
+    return false;
+  }
+  bool ok = true;
+  for (int i = 0; ok && i < header[1]; i++)
+  {
+    ChunkSection *section = &sections[i];
+    int kind = fgetc(f);
+    u16 solid, count = 0;
+    ok = kind != EOF && fread(&solid, sizeof(u16), 1, f) == 1;
+    section->solid_count = solid;
+    if (ok && kind == SPILL_RUNS)
+    {
+      ok = fread(&count, sizeof(u16), 1, f) == 1 && count > 0;
+      size_t bytes = (size_t)count * (sizeof(u16) + 1);
+      section->runs = ok ? malloc(bytes) : NULL;
+      section->run_count = count;
+      ok = section->runs && fread(section->runs, 1, bytes, f) == bytes;
+    }
+    else if (ok && kind == SPILL_RAW)
+    {
+      u8 raw[SECTION_VOLUME];
+      section->blocks = section_blocks_new();
+      ok = section->blocks && fread(raw, 1, SECTION_VOLUME, f) == SECTION_VOLUME;
+      for (int k = 0; ok && k < SECTION_VOLUME; k++)
+      {
+        section->blocks[k] = (BlockType)raw[k];
+      }
+    }
+  }
+  if (!ok)
+  {
+    for (int i = 0; i < header[1]; i++)
+    {
+      section_blocks_release(sections[i].blocks);
+      free(sections[i].runs);
+    }
+    free(sections);
+    return false;
+  }
+  chunk->sections = sections;
+  chunk->section_min = header[0];
+  chunk->section_count = header[1];
+  chunk->packed = true;
+  return true;
+}
+
+// Frees every section of the chunk, leaving it with none
+static void chunk_sections_free(Chunk *chunk)
+{
+  for (int i = 0; i < chunk->section_count; i++)
+  {
+    section_blocks_release(chunk->sections[i].blocks);
+    free(chunk->sections[i].runs);
+  }
+  free(chunk->sections);
+  chunk->sections = NULL;
+  chunk->section_min = 0;
+  chunk->section_count = 0;
 }
 
-static void add_face(Face *faces, int *count, Texture *tex, v3f p0, v3f p1,
-                     v3f p2, v3f p3)
+// Drops the chunk's blocks for the voxel budget; its mesh, heightmap and
+// stage stay, so it keeps drawing and answering column_top. A modified
+// chunk is packed and spilled first, and kept if that fails.
+static bool chunk_unload(Mc *mc, Chunk *chunk)
 {
-  faces[*count].v[0] = (Vertex3D){p0, {0.0f, 1.0f}};
-  faces[*count].v[1] = (Vertex3D){p1, {1.0f, 1.0f}};
-  faces[*count].v[2] = (Vertex3D){p2, {1.0f, 0.0f}};
-  faces[*count].tex = tex;
-  (*count)++;
+  if (chunk->modified)
+  {
+    chunk_pack(chunk);
+    if (!chunk_spill(mc, chunk))
+    {
+      chunk_account(mc, chunk);
+      return false;
+    }
+  }
+  chunk_sections_free(chunk);
+  chunk->packed = false;
+  chunk->unloaded = true;
+  chunk_account(mc, chunk);
+  lru_remove(mc, chunk, LRU_VOXEL);
+  mc->residency.voxel_evicted++;
+  return true;
+}
+
+// Packs, then drops, the blocks of the least recently used chunks until the
+// voxel budget holds again. Only a chunk whose spill failed stays, since
+// dropping it would lose its edits. With spare_current set, chunks used since
+// world_ticks last moved are still being read and stay too; they are the
+// newest in the list, so the walk stops at the first.
+static void voxel_budget_hold(Mc *mc, bool spare_current)
+{
+  Residency *res = &mc->residency;
+  Chunk *chunk = res->lru[LRU_VOXEL].tail;
+  while (res->voxel_budget && res->voxel_bytes > res->voxel_budget && chunk &&
+         !(spare_current && chunk->used_ticks == mc->world_ticks))
+  {
+    Chunk *prev = chunk->lru[LRU_VOXEL].prev;
+    if (!chunk->packed)
+    {
+      chunk_pack(chunk);
+      chunk_account(mc, chunk);
+    }
+    if (res->voxel_bytes > res->voxel_budget)
+    {
+      chunk_unload(mc, chunk);
+    }
+    chunk = prev;
+  }
+}
 
-  faces[*count].v[0] = (Vertex3D){p0, {0.0f, 1.0f}};
-  faces[*count].v[1] = (Vertex3D){p2, {1.0f, 0.0f}};
-  faces[*count].v[2] = (Vertex3D){p3, {0.0f, 0.0f}};
-  faces[*count].tex = tex;
-  (*count)++;
+// Gives an unloaded chunk back exactly the blocks it dropped, regenerated or
+// read from the spill file. False if the spill file could not be read or the
+// blocks could not be regenerated; the chunk then stays unloaded and reads
+// as air.
+bool chunk_reload(Mc *mc, Chunk *chunk)
+{
+  if (!chunk->unloaded)
+  {
+    return true;
+  }
+  if (chunk->modified)
+  {
+    if (!chunk_unspill(mc, chunk))
+    {
+      return false;
+    }
+  }
+  else
+  {
+    u8 stage = chunk->stage;
+    chunk->stage = CHUNK_STAGE_NONE;
+    bool generated = worldgen_advance(chunk, CHUNK_STAGE_HEIGHTMAP);
+    chunk->stage = stage;
+    if (!generated)
+    {
+      chunk_sections_free(chunk);
+      return false;
+    }
+  }
+  chunk->unloaded = false;
+  chunk_touch(mc, chunk);
+  chunk_account(mc, chunk);
+  mc->residency.voxel_reloaded++;
+  voxel_budget_hold(mc, true);
+  return true;
 }
 
-void rebuild_faces(Mc *mc)
+// Resident chunk holding column (x, z), its blocks reloaded if they were
+// dropped for the budget, or NULL
+static Chunk *chunk_at(Mc *mc, int x, int z)
 {
-  mc->face_count = 0;
-  const int max_faces = mc->size_x * mc_height(mc) * mc->size_z * 12;
-  if (!mc->faces || mc->face_cap < max_faces)
+  Chunk *chunk = chunk_map_get(&mc->chunks, floor_div(x, CHUNK_SIZE),
+                               floor_div(z, CHUNK_SIZE));
+  if (!chunk || !chunk_reload(mc, chunk))
   {
-    free(mc->faces);
-    mc->faces = malloc((size_t)max_faces * sizeof(Face));
-    mc->face_cap = max_faces;
+    return NULL;
   }
+  chunk_touch(mc, chunk);
+  return chunk;
+}
 
-#define IS_OPAQUE(ix, iy, iz) block_is_opaque(block_get(mc, (ix), (iy), (iz)))
+static void mark_chunk_dirty(Mc *mc, int cx, int cz, int lx0, int lz0, int lx1,
+                             int lz1);
 
-  int cam_x = (int)floorf(mc->camera.pos.x + (float)mc->size_x * 0.5f);
-  int cam_z = (int)floorf(mc->camera.pos.z + (float)mc->size_z * 0.5f);
-  int radius = mc->render_distance_chunks * CHUNK_SIZE;
-  int x0i = cam_x - radius;
-  int x1i = cam_x + radius;
-  int z0i = cam_z - radius;
-  int z1i = cam_z + radius;
-  if (x0i < 0)
-    x0i = 0;
-  if (z0i < 0)
-    z0i = 0;
-  if (x1i >= mc->size_x)
-    x1i = mc->size_x - 1;
-  if (z1i >= mc->size_z)
-    z1i = mc->size_z - 1;
+// Widens the chunk's column of section slots to include sy. Only the slot
+// array grows; the new slots are empty (all air) until something is placed.
+static bool chunk_reserve_section(Chunk *chunk, int sy)
+{
+  int lo = sy, hi = sy;
+  if (chunk->section_count > 0)
+  {
+    lo = (sy < chunk->section_min) ? sy : chunk->section_min;
+    int top = chunk->section_min + chunk->section_count - 1;
+    hi = (sy > top) ? sy : top;
+    if (lo == chunk->section_min && hi == top)
+    {
+      return true;
+    }
+  }
+  ChunkSection *sections = calloc((size_t)(hi - lo + 1), sizeof(ChunkSection));
+  if (!sections)
+  {
+    return false;
+  }
+  if (chunk->section_count > 0)
+  {
+    memcpy(sections + (chunk->section_min - lo), chunk->sections,
+           (size_t)chunk->section_count * sizeof(ChunkSection));
+  }
+  free(chunk->sections);
+  chunk->sections = sections;
+  chunk->section_min = lo;
+  chunk->section_count = hi - lo + 1;
+  return true;
+}
 
-  for (int x = x0i; x <= x1i; x++)
+// First y at or below from (so from the top down) holding a non-air block,
+// or an opaque one, in the chunk's column.
+static int column_scan(const Chunk *chunk, int lx, int lz, int from, bool opaque)
+{
+  const int end = (chunk->section_min + chunk->section_count) * SECTION_SIZE;
+  int y = (from > chunk->section_min * SECTION_SIZE) ? from
+                                                     : chunk->section_min * SECTION_SIZE;
+  while (y < end)
   {
-    for (int z = z0i; z <= z1i; z++)
+    int sy = floor_div(y, SECTION_SIZE);
+    const ChunkSection *section = chunk_section(chunk, sy);
+    int section_end = (sy + 1) * SECTION_SIZE;
+    int i = section_block_index(lx, y - sy * SECTION_SIZE, lz);
+    for (; !section_empty(section) && y < section_end;
+         y++, i = section_index_inc(i, SECTION_Y_BITS))
     {
-      for (int y = mc->y_min; y <= mc->y_max; y++)
+      BlockType t = section_get(section, i);
+      if (opaque ? block_is_opaque(t) : t != BLOCK_AIR)
       {
-        BlockType type = block_get(mc, x, y, z);
-        if (type == BLOCK_AIR)
-        {
-          continue;
-        }
+        return y;
+      }
+    }
+    y = section_end;
+  }
+  return COLUMN_EMPTY;
+}
 
-        Texture *top_tex = NULL;
-        Texture *side_tex = NULL;
-        Texture *bottom_tex = NULL;
-        switch (type)
-        {
-        case BLOCK_GRASS:
-          top_tex = &mc->grass_top_tex;
-          side_tex = &mc->grass_side_tex;
-          bottom_tex = &mc->dirt_tex;
-          break;
-        case BLOCK_DIRT:
-          top_tex = &mc->dirt_tex;
-          side_tex = &mc->dirt_tex;
-          bottom_tex = side_tex;
-          break;
-        case BLOCK_STONE:
-          top_tex = &mc->stone_tex;
-          side_tex = &mc->stone_tex;
-          bottom_tex = side_tex;
-          break;
-        case BLOCK_OAK_LOG:
-          top_tex = &mc->oak_log_top_tex;
-          side_tex = &mc->oak_log_side_tex;
-          bottom_tex = top_tex;
-          break;
-        case BLOCK_OAK_PLANKS:
-          top_tex = &mc->oak_planks_tex;
-          side_tex = &mc->oak_planks_tex;
-          bottom_tex = side_tex;
-          break;
-        case BLOCK_COBBLESTONE:
-          top_tex = &mc->cobblestone_tex;
-          side_tex = &mc->cobblestone_tex;
-          bottom_tex = side_tex;
-          break;
-        case BLOCK_LEAVES:
-          top_tex = &mc->leaves_tex;
-          side_tex = &mc->leaves_tex;
-          bottom_tex = side_tex;
-          break;
-        case BLOCK_GLASS:
-          top_tex = &mc->glass_tex;
-          side_tex = &mc->glass_tex;
-          bottom_tex = side_tex;
-          break;
-        default:
-          top_tex = &mc->stone_tex;
-          side_tex = &mc->stone_tex;
-          bottom_tex = side_tex;
-          break;
-        }
+// Sets the top non-air block of a column and remembers its type
+static void column_top_set(Chunk *chunk, int lx, int lz, int top)
+{
+  int i = lz * CHUNK_SIZE + lx;
+  chunk->top_solid[i] = top;
+  chunk->top_type[i] =
+      (u8)((top == COLUMN_EMPTY) ? BLOCK_AIR : chunk_block_get(chunk, lx, top, lz));
+}
 
-        float bx = (float)x - (mc->size_x * 0.5f) + 0.5f;
-        float by = -(float)y - 0.5f;
-        float bz = (float)z - (mc->size_z * 0.5f) + 0.5f;
+// Keeps the column tops right after the block at (lx, y, lz) became t.
+static void column_update(Chunk *chunk, int lx, int y, int lz, BlockType t)
+{
+  int i = lz * CHUNK_SIZE + lx;
+  if (t != BLOCK_AIR && y <= chunk->top_solid[i])
+  {
+    chunk->top_solid[i] = y;
+    chunk->top_type[i] = (u8)t;
+  }
+  else if (t == BLOCK_AIR && y == chunk->top_solid[i])
+    column_top_set(chunk, lx, lz, column_scan(chunk, lx, lz, y + 1, false));
+  if (block_is_opaque(t) && y < chunk->top_opaque[i])
+    chunk->top_opaque[i] = y;
+  else if (!block_is_opaque(t) && y == chunk->top_opaque[i])
+    chunk->top_opaque[i] = column_scan(chunk, lx, lz, y + 1, true);
+}
 
-        float x0 = bx - 0.5f, x1 = bx + 0.5f;
-        float y0 = by - 0.5f, y1 = by + 0.5f;
-        float z0 = bz - 0.5f, z1 = bz + 0.5f;
+static void column_rescan(Chunk *chunk, int lx, int lz)
+{
+  int i = lz * CHUNK_SIZE + lx;
+  column_top_set(chunk, lx, lz, column_scan(chunk, lx, lz, INT_MIN, false));
+  chunk->top_opaque[i] = (chunk->top_solid[i] == COLUMN_EMPTY)
+                             ? COLUMN_EMPTY
+                             : column_scan(chunk, lx, lz, chunk->top_solid[i], true);
+}
 
-        if (!IS_OPAQUE(x, y - 1, z))
-        { // top (+y in world)
-          Texture *tex = top_tex;
-          add_face(mc->faces, &mc->face_count, tex,
-                   (v3f){x0, y1, z1}, (v3f){x1, y1, z1}, (v3f){x1, y1, z0},
-                   (v3f){x0, y1, z0});
-        }
-        if (!IS_OPAQUE(x, y + 1, z))
-        { // bottom (-y in world)
-          add_face(mc->faces, &mc->face_count, bottom_tex,
-                   (v3f){x0, y0, z0}, (v3f){x1, y0, z0}, (v3f){x1, y0, z1},
-                   (v3f){x0, y0, z1});
-        }
-        if (!IS_OPAQUE(x, y, z + 1))
-        { // front (+z)
-          add_face(mc->faces, &mc->face_count, side_tex,
-                   (v3f){x0, y0, z1}, (v3f){x1, y0, z1}, (v3f){x1, y1, z1},
-                   (v3f){x0, y1, z1});
-        }
-        if (!IS_OPAQUE(x, y, z - 1))
-        { // back (-z)
-          add_face(mc->faces, &mc->face_count, side_tex,
-                   (v3f){x1, y0, z0}, (v3f){x0, y0, z0}, (v3f){x0, y1, z0},
-                   (v3f){x1, y1, z0});
-        }
-        if (!IS_OPAQUE(x - 1, y, z))
-        { // left (-x)
-          add_face(mc->faces, &mc->face_count, side_tex,
-                   (v3f){x0, y0, z0}, (v3f){x0, y0, z1}, (v3f){x0, y1, z1},
-                   (v3f){x0, y1, z0});
-        }
-        if (!IS_OPAQUE(x + 1, y, z))
-        { // right (+x)
-          add_face(mc->faces, &mc->face_count, side_tex,
-                   (v3f){x1, y0, z1}, (v3f){x1, y0, z0}, (v3f){x1, y1, z0},
-                   (v3f){x1, y1, z1});
-        }
+void chunk_heightmap_rebuild(Chunk *chunk)
+{
+  for (int lz = 0; lz < CHUNK_SIZE; lz++)
+  {
+    for (int lx = 0; lx < CHUNK_SIZE; lx++)
+    {
+      column_rescan(chunk, lx, lz);
+    }
+  }
+}
+
+int chunk_column_top(const Chunk *chunk, int lx, int lz, bool opaque)
+{
+  int i = lz * CHUNK_SIZE + lx;
+  return opaque ? chunk->top_opaque[i] : chunk->top_solid[i];
+}
+
+// Type of the block at chunk_column_top(..., false), from the heightmap
+BlockType chunk_column_type(const Chunk *chunk, int lx, int lz)
+{
+  return (BlockType)chunk->top_type[lz * CHUNK_SIZE + lx];
+}
+
+BlockType chunk_block_get(const Chunk *chunk, int lx, int y, int lz)
+{
+  const ChunkSection *section = chunk_section(chunk, floor_div(y, SECTION_SIZE));
+  return section ? section_get(section, section_block_index(
+                                            lx, floor_mod(y, SECTION_SIZE), lz))
+                 : BLOCK_AIR;
+}
+
+// Section sy ready to be written: allocated (all air) if it was empty,
+// unpacked if it was packed, and given its own copy of the blocks if a
+// snapshot still shares them.
+ChunkSection *chunk_section_alloc(Chunk *chunk, int sy)
+{
+  ChunkSection *section = chunk_section(chunk, sy);
+  if (section && !section_unpack(section))
+  {
+    return NULL;
+  }
+  if (section && section->blocks)
+  {
+    if (SDL_AtomicGet(&section_store(section->blocks)->refs) > 1)
+    {
+      BlockType *copy = section_blocks_new();
+      if (!copy)
+      {
+        return NULL;
       }
+      memcpy(copy, section->blocks, SECTION_VOLUME * sizeof(BlockType));
+      section_blocks_release(section->blocks);
+      section->blocks = copy;
     }
+    return section;
+  }
+  if (!chunk_reserve_section(chunk, sy))
+  {
+    return NULL;
+  }
+  section = chunk_section(chunk, sy);
+  section->blocks = section_blocks_new();
+  return section->blocks ? section : NULL;
+}
+
+// Writes one block, allocating its section on the first solid block and
+// freeing it again once it holds nothing but air. Touches nothing but the
+// chunk, so generator threads can use it on chunks they own.
+bool chunk_block_set(Chunk *chunk, int lx, int y, int lz, BlockType t)
+{
+  int sy = floor_div(y, SECTION_SIZE);
+  if (t == BLOCK_AIR && section_empty(chunk_section(chunk, sy)))
+  {
+    return true;
+  }
+  ChunkSection *section = chunk_section_alloc(chunk, sy);
+  if (!section)
+  {
+    return false;
+  }
+  BlockType *block =
+      &section->blocks[section_block_index(lx, y - sy * SECTION_SIZE, lz)];
+  section->solid_count += (t != BLOCK_AIR) - (*block != BLOCK_AIR);
+  *block = t;
+  if (section->solid_count == 0)
+  {
+    section_blocks_release(section->blocks);
+    section->blocks = NULL;
+  }
+  column_update(chunk, lx, y, lz, t);
+  return true;
+}
+
+// Writes the part of a structure that falls inside the chunk, with its
+// anchor at chunk-local (lx, y, lz). Rows are clipped to the chunk once and
+// written straight into the section arrays. With into_air set, only air is
+// replaced, so structures stamped that way never overwrite each other.
+bool chunk_stamp(Chunk *chunk, const Structure *s, int lx, int y, int lz,
+                 bool into_air)
+{
+  const int x0 = lx - s->ox, y0 = y - s->oy, z0 = lz - s->oz;
+  const int sx_lo = (x0 < 0) ? -x0 : 0;
+  const int sx_hi = (x0 + s->w > CHUNK_SIZE) ? CHUNK_SIZE - x0 : s->w;
+  const int sz_lo = (z0 < 0) ? -z0 : 0;
+  const int sz_hi = (z0 + s->d > CHUNK_SIZE) ? CHUNK_SIZE - z0 : s->d;
+  for (int sy = 0; sy < s->h; sy++)
+  {
+    const int wy = y0 + sy;
+    const int sec = floor_div(wy, SECTION_SIZE);
+    ChunkSection *section = NULL;
+    for (int sz = sz_lo; sz < sz_hi; sz++)
+    {
+      const BlockType *row = &s->blocks[(sy * s->d + sz) * s->w];
+      for (int sx = sx_lo; sx < sx_hi; sx++)
+      {
+        if (row[sx] == BLOCK_AIR)
+        {
+          continue;
+        }
+        if (!section && !(section = chunk_section_alloc(chunk, sec)))
+        {
+          return false;
+        }
+        BlockType *block = &section->blocks[section_block_index(
+            x0 + sx, wy - sec * SECTION_SIZE, z0 + sz)];
+        if (*block == BLOCK_AIR)
+        {
+          section->solid_count++;
+        }
+        else if (into_air)
+        {
+          continue;
+        }
+        *block = row[sx];
+        column_update(chunk, x0 + sx, wy, z0 + sz, row[sx]);
+      }
+    }
+  }
+  return true;
+}
+
+// Widens the world's y extent to cover the chunk's section slots.
+static void world_include_chunk(Mc *mc, const Chunk *chunk)
+{
+  if (chunk->section_count == 0)
+  {
+    return;
+  }
+  int lo = chunk->section_min * SECTION_SIZE;
+  int hi = (chunk->section_min + chunk->section_count) * SECTION_SIZE - 1;
+  if (lo < mc->y_min)
+    mc->y_min = lo;
+  if (hi > mc->y_max)
+    mc->y_max = hi;
+}
+
+// Air outside the resident chunks
+BlockType block_get(Mc *mc, int x, int y, int z)
+{
+  Chunk *chunk = chunk_at(mc, x, z);
+  if (!chunk)
+  {
+    return BLOCK_AIR;
+  }
+  return chunk_block_get(chunk, floor_mod(x, CHUNK_SIZE), y,
+                         floor_mod(z, CHUNK_SIZE));
+}
+
+// References every section of the chunks under box, reloading and unpacking
+// them first. Taken on the main thread like any chunk map access; read and
+// released anywhere.
+bool chunk_snapshot_take(Mc *mc, BlockBox box, ChunkSnapshot *snap)
+{
+  *snap = (ChunkSnapshot){0};
+  const int cx0 = floor_div(box.x0, CHUNK_SIZE);
+  const int cz0 = floor_div(box.z0, CHUNK_SIZE);
+  const int w = floor_div(box.x1, CHUNK_SIZE) - cx0 + 1;
+  const int d = floor_div(box.z1, CHUNK_SIZE) - cz0 + 1;
+  if (w <= 0 || d <= 0)
+  {
+    return false;
+  }
+  int total = 0;
+  for (int i = 0; i < w * d; i++)
+  {
+    Chunk *chunk = chunk_map_get(&mc->chunks, cx0 + i % w, cz0 + i / w);
+    if (!chunk)
+    {
+      continue;
+    }
+    if (!chunk_reload(mc, chunk) || !chunk_unpack(chunk))
+    {
+      return false;
+    }
+    chunk_touch(mc, chunk);
+    chunk_account(mc, chunk);
+    total += chunk->section_count;
+  }
+  SnapshotColumn *columns = calloc((size_t)(w * d), sizeof(*columns));
+  const BlockType **storage = malloc((size_t)(total + 1) * sizeof(*storage));
+  if (!columns || !storage)
+  {
+    free(columns);
+    free(storage);
+    return false;
+  }
+  *snap = (ChunkSnapshot){cx0, cz0, w, d, columns, storage};
+  const BlockType **next = storage;
+  for (int i = 0; i < w * d; i++)
+  {
+    const Chunk *chunk = chunk_map_get(&mc->chunks, cx0 + i % w, cz0 + i / w);
+    SnapshotColumn *column = &columns[i];
+    column->sections = next;
+    if (!chunk)
+    {
+      continue;
+    }
+    column->section_min = chunk->section_min;
+    column->section_count = chunk->section_count;
+    for (int sec = 0; sec < column->section_count; sec++)
+    {
+      const BlockType *blocks = chunk->sections[sec].blocks;
+      if (blocks)
+      {
+        section_blocks_retain(blocks);
+      }
+      *next++ = blocks;
+    }
+  }
+  return true;
+}
+
+void chunk_snapshot_release(ChunkSnapshot *snap)
+{
+  for (int i = 0; i < snap->w * snap->d; i++)
+  {
+    const SnapshotColumn *column = &snap->columns[i];
+    for (int sec = 0; sec < column->section_count; sec++)
+    {
+      section_blocks_release(column->sections[sec]);
+    }
+  }
+  free(snap->columns);
+  free(snap->storage);
+  *snap = (ChunkSnapshot){0};
+}
+
+// Blocks of section sy in the snapshot column holding world column (x, z);
+// NULL if the section is all air or outside the snapshot.
+static const BlockType *snapshot_section(const ChunkSnapshot *snap, int x,
+                                         int sy, int z)
+{
+  int dx = floor_div(x, CHUNK_SIZE) - snap->cx0;
+  int dz = floor_div(z, CHUNK_SIZE) - snap->cz0;
+  if (dx < 0 || dx >= snap->w || dz < 0 || dz >= snap->d)
+  {
+    return NULL;
+  }
+  const SnapshotColumn *column = &snap->columns[dz * snap->w + dx];
+  int i = sy - column->section_min;
+  return (i >= 0 && i < column->section_count) ? column->sections[i] : NULL;
+}
+
+BlockType snapshot_block_get(const ChunkSnapshot *snap, int x, int y, int z)
+{
+  int sy = floor_div(y, SECTION_SIZE);
+  const BlockType *blocks = snapshot_section(snap, x, sy, z);
+  return blocks ? blocks[section_block_index(floor_mod(x, CHUNK_SIZE),
+                                             y - sy * SECTION_SIZE,
+                                             floor_mod(z, CHUNK_SIZE))]
+                : BLOCK_AIR;
+}
+
+// Smallest y of a non-air (or opaque) block in column (x, z), in O(1).
+// COLUMN_EMPTY if there is none or the chunk is not resident. Unloaded
+// chunks keep their heightmap, so they are not reloaded for this.
+int column_top(const Mc *mc, int x, int z, bool opaque)
+{
+  const Chunk *chunk = chunk_map_get(&mc->chunks, floor_div(x, CHUNK_SIZE),
+                                     floor_div(z, CHUNK_SIZE));
+  if (!chunk)
+  {
+    return COLUMN_EMPTY;
+  }
+  return chunk_column_top(chunk, floor_mod(x, CHUNK_SIZE), floor_mod(z, CHUNK_SIZE),
+                          opaque);
+}
+
+void block_set(Mc *mc, int x, int y, int z, BlockType t)
+{
+  Chunk *chunk = chunk_at(mc, x, z);
+  if (!chunk)
+  {
+    return;
+  }
+  if (!chunk_block_set(chunk, floor_mod(x, CHUNK_SIZE), y, floor_mod(z, CHUNK_SIZE),
+                       t))
+  {
+    return;
+  }
+  world_include_chunk(mc, chunk);
+  chunk->modified = true;
+  chunk_account(mc, chunk);
+  int lx = floor_mod(x, CHUNK_SIZE);
+  int lz = floor_mod(z, CHUNK_SIZE);
+  mark_chunk_dirty(mc, chunk->cx, chunk->cz, lx, lz, lx, lz);
+  far_terrain_mark(mc, x, z, x, z);
+}
+
+// Resident chunk (cx, cz), reloaded, or NULL
+static Chunk *batch_chunk(Mc *mc, int cx, int cz)
+{
+  Chunk *chunk = chunk_map_get(&mc->chunks, cx, cz);
+  return (chunk && chunk_reload(mc, chunk)) ? chunk : NULL;
+}
+
+// Records that the columns lx0..lx1 x lz0..lz1 of chunk were written; with
+// rescan set their tops were not kept up and are rescanned at the end.
+static void batch_touch(Mc *mc, EditBatch *batch, Chunk *chunk, int lx0, int lz0,
+                        int lx1, int lz1, bool rescan)
+{
+  EditTouch *t = NULL;
+  for (int i = batch->count - 1; i >= 0 && !t; i--)
+  {
+    if (batch->touched[i].chunk == chunk)
+    {
+      t = &batch->touched[i];
+    }
+  }
+  if (!t)
+  {
+    if (batch->count == batch->cap)
+    {
+      int cap = batch->cap ? batch->cap * 2 : 16;
+      EditTouch *grown = realloc(batch->touched, (size_t)cap * sizeof(EditTouch));
+      if (!grown)
+      {
+        // Without a slot the chunk would never be invalidated, so mark it
+        // here; edit_batch_finish then requests the remesh.
+        if (rescan)
+        {
+          chunk_heightmap_rebuild(chunk);
+        }
+        world_include_chunk(mc, chunk);
+        chunk->modified = true;
+        mark_chunk_dirty(mc, chunk->cx, chunk->cz, 0, 0, CHUNK_SIZE - 1,
+                         CHUNK_SIZE - 1);
+        batch->failed = true;
+        return;
+      }
+      batch->touched = grown;
+      batch->cap = cap;
+    }
+    t = &batch->touched[batch->count++];
+    *t = (EditTouch){chunk, lx0, lz0, lx1, lz1, rescan};
+    return;
+  }
+  t->rescan |= rescan;
+  if (lx0 < t->lx0)
+    t->lx0 = lx0;
+  if (lz0 < t->lz0)
+    t->lz0 = lz0;
+  if (lx1 > t->lx1)
+    t->lx1 = lx1;
+  if (lz1 > t->lz1)
+    t->lz1 = lz1;
+}
+
+// Writes one block as part of a batch; false if its chunk is not resident
+// or the write failed.
+bool edit_batch_set(Mc *mc, EditBatch *batch, int x, int y, int z, BlockType t)
+{
+  int cx = floor_div(x, CHUNK_SIZE);
+  int cz = floor_div(z, CHUNK_SIZE);
+  Chunk *chunk = batch->last;
+  if (!chunk || chunk->cx != cx || chunk->cz != cz)
+  {
+    chunk = batch->last = batch_chunk(mc, cx, cz);
+    if (!chunk)
+    {
+      return false;
+    }
+  }
+  int lx = x - cx * CHUNK_SIZE;
+  int lz = z - cz * CHUNK_SIZE;
+  if (!chunk_block_set(chunk, lx, y, lz, t))
+  {
+    batch->failed = true;
+    return false;
+  }
+  batch_touch(mc, batch, chunk, lx, lz, lx, lz, false);
+  return true;
+}
+
+// Writes n blocks of type t in a row of one section, from chunk-local
+// (lx, y, lz) one block at a time along x (dx = 1 or -1) or z (dz = 1 or -1),
+// which must all fall inside the chunk. The column tops are left alone.
+static bool chunk_row_write(Chunk *chunk, int lx, int y, int lz, int dx, int dz,
+                            int n, BlockType t)
+{
+  int sy = floor_div(y, SECTION_SIZE);
+  if (t == BLOCK_AIR && section_empty(chunk_section(chunk, sy)))
+  {
+    return true;
+  }
+  ChunkSection *section = chunk_section_alloc(chunk, sy);
+  if (!section)
+  {
+    return false;
+  }
+  const int axis_bits = dx ? SECTION_X_BITS : SECTION_Z_BITS;
+  int i = section_block_index(lx, y - sy * SECTION_SIZE, lz);
+  for (int k = 0; k < n; k++)
+  {
+    BlockType *block = &section->blocks[i];
+    section->solid_count += (t != BLOCK_AIR) - (*block != BLOCK_AIR);
+    *block = t;
+    i = (dx + dz > 0) ? section_index_inc(i, axis_bits)
+                      : section_index_dec(i, axis_bits);
+  }
+  if (section->solid_count == 0)
+  {
+    section_blocks_release(section->blocks);
+    section->blocks = NULL;
+  }
+  return true;
+}
+
+// Writes n blocks of type t in a row from (x, y, z), stepping one block
+// along x (dx = 1 or -1) or z (dz = 1 or -1), as part of a batch. Each piece
+// of the row goes straight into its section's blocks, and the column tops
+// are rescanned once per chunk by edit_batch_finish rather than per block.
+// False if a chunk under the row is not resident or a write failed; the
+// rest of the row is still written.
+bool edit_batch_row(Mc *mc, EditBatch *batch, int x, int y, int z, int dx, int dz,
+                    int n, BlockType t)
+{
+  bool ok = true;
+  while (n > 0)
+  {
+    int cx = floor_div(x, CHUNK_SIZE);
+    int cz = floor_div(z, CHUNK_SIZE);
+    int lx = x - cx * CHUNK_SIZE;
+    int lz = z - cz * CHUNK_SIZE;
+    int fit = (dx > 0)   ? CHUNK_SIZE - lx
+              : (dx < 0) ? lx + 1
+              : (dz > 0) ? CHUNK_SIZE - lz
+                         : lz + 1;
+    int count = (n < fit) ? n : fit;
+    Chunk *chunk = batch->last;
+    if (!chunk || chunk->cx != cx || chunk->cz != cz)
+    {
+      chunk = batch->last = batch_chunk(mc, cx, cz);
+    }
+    if (!chunk)
+    {
+      ok = false;
+    }
+    else if (!chunk_row_write(chunk, lx, y, lz, dx, dz, count, t))
+    {
+      batch->failed = true;
+      ok = false;
+    }
+    else
+    {
+      int ex = lx + dx * (count - 1), ez = lz + dz * (count - 1);
+      batch_touch(mc, batch, chunk, (ex < lx) ? ex : lx, (ez < lz) ? ez : lz,
+                  (ex > lx) ? ex : lx, (ez > lz) ? ez : lz, true);
+    }
+    x += dx * count;
+    z += dz * count;
+    n -= count;
+  }
+  return ok;
+}
+
+// Invalidates every touched chunk once: its column tops where they were not
+// kept up, y extent, meshes (its own and the neighbours the edit came near)
+// and far-terrain tiles. Returns the number of chunks touched and leaves the
+// batch empty, ready for reuse.
+int edit_batch_finish(Mc *mc, EditBatch *batch)
+{
+  for (int i = 0; i < batch->count; i++)
+  {
+    const EditTouch *t = &batch->touched[i];
+    Chunk *chunk = t->chunk;
+    for (int lz = t->lz0; t->rescan && lz <= t->lz1; lz++)
+    {
+      for (int lx = t->lx0; lx <= t->lx1; lx++)
+      {
+        column_rescan(chunk, lx, lz);
+      }
+    }
+    world_include_chunk(mc, chunk);
+    chunk->modified = true;
+    chunk_touch(mc, chunk);
+    chunk_account(mc, chunk);
+    mark_chunk_dirty(mc, chunk->cx, chunk->cz, t->lx0, t->lz0, t->lx1, t->lz1);
+    const int x0 = chunk->cx * CHUNK_SIZE, z0 = chunk->cz * CHUNK_SIZE;
+    far_terrain_mark(mc, x0 + t->lx0, z0 + t->lz0, x0 + t->lx1, z0 + t->lz1);
+  }
+  int count = batch->count;
+  free(batch->touched);
+  *batch = (EditBatch){0};
+  return count;
+}
+
+// Writes t into the part of box inside each resident chunk, section by
+// section; with only_from set, only blocks that were from are replaced.
+static int region_write(Mc *mc, BlockBox box, bool only_from, BlockType from,
+                        BlockType t)
+{
+  EditBatch batch = {0};
+  for (int cz = floor_div(box.z0, CHUNK_SIZE); cz <= floor_div(box.z1, CHUNK_SIZE); cz++)
+  {
+    for (int cx = floor_div(box.x0, CHUNK_SIZE); cx <= floor_div(box.x1, CHUNK_SIZE);
+         cx++)
+    {
+      Chunk *chunk = batch_chunk(mc, cx, cz);
+      if (!chunk)
+      {
+        continue;
+      }
+      const int lx0 = (box.x0 > cx * CHUNK_SIZE) ? box.x0 - cx * CHUNK_SIZE : 0;
+      const int lz0 = (box.z0 > cz * CHUNK_SIZE) ? box.z0 - cz * CHUNK_SIZE : 0;
+      const int lx1 = (box.x1 < (cx + 1) * CHUNK_SIZE) ? box.x1 - cx * CHUNK_SIZE
+                                                       : CHUNK_SIZE - 1;
+      const int lz1 = (box.z1 < (cz + 1) * CHUNK_SIZE) ? box.z1 - cz * CHUNK_SIZE
+                                                       : CHUNK_SIZE - 1;
+      bool changed = false;
+      for (int sy = floor_div(box.y0, SECTION_SIZE); sy <= floor_div(box.y1, SECTION_SIZE);
+           sy++)
+      {
+        // Air going into an empty section, or replacing blocks it does not
+        // have, changes nothing
+        bool empty = section_empty(chunk_section(chunk, sy));
+        if (empty && (only_from ? from != BLOCK_AIR : t == BLOCK_AIR))
+        {
+          continue;
+        }
+        ChunkSection *section = chunk_section_alloc(chunk, sy);
+        if (!section)
+        {
+          batch.failed = true;
+          continue;
+        }
+        const int ly0 = (box.y0 > sy * SECTION_SIZE) ? box.y0 - sy * SECTION_SIZE : 0;
+        const int ly1 = (box.y1 < (sy + 1) * SECTION_SIZE) ? box.y1 - sy * SECTION_SIZE
+                                                           : SECTION_SIZE - 1;
+        for (int ly = ly0; ly <= ly1; ly++)
+        {
+          for (int lz = lz0; lz <= lz1; lz++)
+          {
+            for (int lx = lx0; lx <= lx1; lx++)
+            {
+              BlockType *block = &section->blocks[section_block_index(lx, ly, lz)];
+              if (*block == t || (only_from && *block != from))
+              {
+                continue;
+              }
+              section->solid_count += (t != BLOCK_AIR) - (*block != BLOCK_AIR);
+              *block = t;
+              changed = true;
+            }
+          }
+        }
+        if (section->solid_count == 0)
+        {
+          section_blocks_release(section->blocks);
+          section->blocks = NULL;
+        }
+      }
+      if (changed)
+      {
+        batch_touch(mc, &batch, chunk, lx0, lz0, lx1, lz1, true);
+      }
+    }
+  }
+  return edit_batch_finish(mc, &batch);
+}
+
+// Region edits write straight into the resident chunks in box (inclusive,
+// world block coordinates) and invalidate each touched chunk once rather
+// than once per block. Blocks in chunks that are not resident are skipped,
+// as with block_set. All return the number of chunks touched.
+int region_fill(Mc *mc, BlockBox box, BlockType t)
+{
+  return region_write(mc, box, false, BLOCK_AIR, t);
+}
+
+int region_replace(Mc *mc, BlockBox box, BlockType from, BlockType to)
+{
+  return region_write(mc, box, true, from, to);
+}
+
+// Writes a structure with its anchor at (x, y, z); see chunk_stamp.
+int region_stamp(Mc *mc, const Structure *s, int x, int y, int z, bool into_air)
+{
+  EditBatch batch = {0};
+  const int x0 = x - s->ox, z0 = z - s->oz;
+  for (int cz = floor_div(z0, CHUNK_SIZE); cz <= floor_div(z0 + s->d - 1, CHUNK_SIZE);
+       cz++)
+  {
+    for (int cx = floor_div(x0, CHUNK_SIZE); cx <= floor_div(x0 + s->w - 1, CHUNK_SIZE);
+         cx++)
+    {
+      Chunk *chunk = batch_chunk(mc, cx, cz);
+      if (!chunk)
+      {
+        continue;
+      }
+      if (!chunk_stamp(chunk, s, x - cx * CHUNK_SIZE, y, z - cz * CHUNK_SIZE, into_air))
+      {
+        batch.failed = true;
+      }
+      int lx0 = x0 - cx * CHUNK_SIZE, lz0 = z0 - cz * CHUNK_SIZE;
+      int lx1 = lx0 + s->w - 1, lz1 = lz0 + s->d - 1;
+      batch_touch(mc, &batch, chunk, (lx0 < 0) ? 0 : lx0, (lz0 < 0) ? 0 : lz0,
+                  (lx1 >= CHUNK_SIZE) ? CHUNK_SIZE - 1 : lx1,
+                  (lz1 >= CHUNK_SIZE) ? CHUNK_SIZE - 1 : lz1, false);
+    }
+  }
+  return edit_batch_finish(mc, &batch);
+}
+
+// Writes a list of single blocks, e.g. the result of an explosion.
+int region_apply(Mc *mc, const BlockEdit *edits, int count)
+{
+  EditBatch batch = {0};
+  for (int i = 0; i < count; i++)
+  {
+    edit_batch_set(mc, &batch, edits[i].x, edits[i].y, edits[i].z, edits[i].type);
+  }
+  return edit_batch_finish(mc, &batch);
+}
+
+#define SKIRT_DEPTH (1 << (LOD_LEVELS - 1))
+#define STREAM_CHUNKS_PER_CALL 16 // generated per frame without worker threads
+#define CHUNK_COLD_MS 10000       // unused this long, a chunk's blocks are packed
+#define PACK_SLOTS_PER_CALL 64
+#define MESH_KEEP_MS 1000 // meshes seen this recently are evicted last
+
+void camera_chunk(const Mc *mc, int *cx, int *cz)
+{
+  *cx = floor_div((int)floorf(mc->camera.pos.x), CHUNK_SIZE);
+  *cz = floor_div((int)floorf(mc->camera.pos.z), CHUNK_SIZE);
+}
+
+ChunkMesh *chunk_mesh_get(Mc *mc, int cx, int cz)
+{
+  Chunk *chunk = chunk_map_get(&mc->chunks, cx, cz);
+  return chunk ? &chunk->mesh : NULL;
+}
+
+// Lists chunk (cx, cz) for rebuild_faces to look at. If the queue cannot
+// grow, the next call rescans the whole render distance instead.
+void mesh_queue_push(Mc *mc, int cx, int cz)
+{
+  MeshQueue *q = &mc->mesh_queue;
+  Chunk *chunk = chunk_map_get(&mc->chunks, cx, cz);
+  mc->mesh_dirty = true;
+  if (!chunk || chunk->mesh.queued)
+  {
+    return;
+  }
+  if (q->count == q->cap)
+  {
+    int cap = q->cap ? q->cap * 2 : 64;
+    ChunkPos *grown = realloc(q->chunks, (size_t)cap * sizeof(ChunkPos));
+    if (!grown)
+    {
+      q->scanned = false;
+      return;
+    }
+    q->chunks = grown;
+    q->cap = cap;
+  }
+  q->chunks[q->count++] = (ChunkPos){cx, cz};
+  chunk->mesh.queued = true;
+}
+
+static int chunk_distance(const Mc *mc, int cx, int cz)
+{
+  int dx = abs(cx - mc->chunk_cx);
+  int dz = abs(cz - mc->chunk_cz);
+  return (dx > dz) ? dx : dz;
+}
+
+// Lower is sooner: the distance from the camera to the chunk's centre,
+// weighted up to twice that for chunks straight behind the view direction.
+static float chunk_priority(const Mc *mc, int cx, int cz)
+{
+  float dx = (float)(cx * CHUNK_SIZE + CHUNK_SIZE / 2) - mc->camera.pos.x;
+  float dz = (float)(cz * CHUNK_SIZE + CHUNK_SIZE / 2) - mc->camera.pos.z;
+  float dist = sqrtf(dx * dx + dz * dz);
+  if (dist == 0.0f)
+  {
+    return 0.0f;
+  }
+  float facing = (dx * sinf(mc->camera.yaw) - dz * cosf(mc->camera.yaw)) / dist;
+  return dist * (1.5f - 0.5f * facing);
+}
+
+static int chunk_lod(const Mc *mc, int cx, int cz)
+{
+  int d = chunk_distance(mc, cx, cz);
+  int lod = 0;
+  while (lod < LOD_LEVELS - 1 && d >= mc->lod_distance_chunks[lod])
+  {
+    lod++;
+  }
+  return lod;
+}
+
+// Borders whose neighbour is drawn at another LOD (or as far terrain) get
+// skirts to hide cracks.
+static u8 chunk_skirt_mask(const Mc *mc, int cx, int cz, int lod)
+{
+  static const int ndx[4] = {-1, 1, 0, 0};
+  static const int ndz[4] = {0, 0, -1, 1};
+  u8 mask = 0;
+  for (int i = 0; i < 4; i++)
+  {
+    int nx = cx + ndx[i];
+    int nz = cz + ndz[i];
+    // Past the render distance the neighbour is the far-terrain heightmap.
+    if (chunk_distance(mc, nx, nz) > mc->render_distance_chunks ||
+        chunk_lod(mc, nx, nz) != lod)
+    {
+      mask |= (u8)(1 << i);
+    }
+  }
+  return mask;
+}
+
+// Marks chunk (cx, cz) for remeshing after an edit to its columns lx0..lx1,
+// lz0..lz1, along with the neighbours the edit came near.
+static void mark_chunk_dirty(Mc *mc, int cx, int cz, int lx0, int lz0, int lx1,
+                             int lz1)
+{
+  // Downsampled neighbours read up to one coarse cell across the border.
+  const int margin = 1 << (LOD_LEVELS - 1);
+  for (int dz = -1; dz <= 1; dz++)
+  {
+    if ((dz < 0 && lz0 >= margin) || (dz > 0 && lz1 < CHUNK_SIZE - margin))
+      continue;
+    for (int dx = -1; dx <= 1; dx++)
+    {
+      if ((dx < 0 && lx0 >= margin) || (dx > 0 && lx1 < CHUNK_SIZE - margin))
+        continue;
+      ChunkMesh *mesh = chunk_mesh_get(mc, cx + dx, cz + dz);
+      if (mesh)
+      {
+        mesh->dirty = true;
+        mesh->evicted = false;
+        mesh_queue_push(mc, cx + dx, cz + dz);
+      }
+    }
+  }
+}
+
+static bool add_face(MeshPool *pool, ChunkMesh *mesh, Texture *tex, v3f p0,
+                     v3f p1, v3f p2, v3f p3)
+{
+  Face *a = chunk_mesh_push(pool, mesh);
+  Face *b = a ? chunk_mesh_push(pool, mesh) : NULL;
+  if (!b)
+  {
+    return false;
+  }
+
+  a->v[0] = (Vertex3D){p0, {0.0f, 1.0f}};
+  a->v[1] = (Vertex3D){p1, {1.0f, 1.0f}};
+  a->v[2] = (Vertex3D){p2, {1.0f, 0.0f}};
+  a->tex = tex;
+
+  b->v[0] = (Vertex3D){p0, {0.0f, 1.0f}};
+  b->v[1] = (Vertex3D){p2, {1.0f, 0.0f}};
+  b->v[2] = (Vertex3D){p3, {0.0f, 0.0f}};
+  b->tex = tex;
+  return true;
+}
+
+// Emits one side of the box spanning [x0,x1] x [y0,y1] x [z0,z1] in world space.
+static bool add_box_face(MeshPool *pool, ChunkMesh *mesh, Texture *tex,
+                         FaceDir dir, float x0, float x1, float y0, float y1,
+                         float z0, float z1)
+{
+  switch (dir)
+  {
+  case FACE_TOP:
+    return add_face(pool, mesh, tex, (v3f){x0, y1, z1}, (v3f){x1, y1, z1},
+                    (v3f){x1, y1, z0}, (v3f){x0, y1, z0});
+  case FACE_BOTTOM:
+    return add_face(pool, mesh, tex, (v3f){x0, y0, z0}, (v3f){x1, y0, z0},
+                    (v3f){x1, y0, z1}, (v3f){x0, y0, z1});
+  case FACE_FRONT:
+    return add_face(pool, mesh, tex, (v3f){x0, y0, z1}, (v3f){x1, y0, z1},
+                    (v3f){x1, y1, z1}, (v3f){x0, y1, z1});
+  case FACE_BACK:
+    return add_face(pool, mesh, tex, (v3f){x1, y0, z0}, (v3f){x0, y0, z0},
+                    (v3f){x0, y1, z0}, (v3f){x1, y1, z0});
+  case FACE_LEFT:
+    return add_face(pool, mesh, tex, (v3f){x0, y0, z0}, (v3f){x0, y0, z1},
+                    (v3f){x0, y1, z1}, (v3f){x0, y1, z0});
+  case FACE_RIGHT:
+    return add_face(pool, mesh, tex, (v3f){x1, y0, z1}, (v3f){x1, y0, z0},
+                    (v3f){x1, y1, z0}, (v3f){x1, y1, z1});
+  }
+  return false;
+}
+
+// The chunk being meshed and its eight neighbours, (dz + 1) * 3 + dx + 1;
+// NULL where a neighbour is not resident.
+typedef struct
+{
+  int cx, cz;
+  const Chunk *chunks[9];
+} MeshArea;
+
+// Cell grid of one section with a one-cell halo on every side, and one word
+// per cell row along x, bit ix + 1 set for opaque cells (which hide their
+// neighbours' faces), then the same for cells drawn in the direction groups
+// and for cells in the blended group, so a whole row of neighbour tests is a
+// shift and an AND. Sized for LOD 0, shared by every chunk meshed in a call.
+typedef struct
+{
+  BlockType *grid;
+  u32 *opaque;
+} MeshScratch;
+
+#define MESH_GRID_CELLS                                                        \
+  ((CHUNK_SIZE + 2) * (SECTION_SIZE + 2) * (CHUNK_SIZE + 2))
+#define MESH_GRID_ROWS ((SECTION_SIZE + 2) * (CHUNK_SIZE + 2))
+
+// Copies count blocks of one x row starting at x0; air where nothing is stored.
+static void read_row(const MeshArea *area, int x0, int y, int z, int count,
+                     BlockType *out)
+{
+  // One section lookup per run of the row that falls in the same chunk
+  int sy = floor_div(y, SECTION_SIZE);
+  int ly = y - sy * SECTION_SIZE;
+  int lz = floor_mod(z, CHUNK_SIZE);
+  int dz = floor_div(z, CHUNK_SIZE) - area->cz;
+  int i = 0;
+  while (i < count)
+  {
+    int x = x0 + i;
+    int lx = floor_mod(x, CHUNK_SIZE);
+    int run = CHUNK_SIZE - lx;
+    if (run > count - i)
+    {
+      run = count - i;
+    }
+    int dx = floor_div(x, CHUNK_SIZE) - area->cx;
+    const Chunk *chunk = area->chunks[(dz + 1) * 3 + dx + 1];
+    const ChunkSection *section = chunk ? chunk_section(chunk, sy) : NULL;
+    if (section)
+    {
+      section_row_get(section, lx, ly, lz, run, out + i);
+    }
+    else
+    {
+      memset(out + i, 0, (size_t)run * sizeof(BlockType));
+    }
+    i += run;
+  }
+}
+
+// Majority block type of an s^3 cell; grass counts as dirt with a lit top so
+// distant hills keep their colour.
+static BlockType downsample_cell(const MeshArea *area, int x0, int y0, int z0,
+                                 int s)
+{
+  BlockType row[CHUNK_SIZE];
+  if (s == 1)
+  {
+    read_row(area, x0, y0, z0, 1, row);
+    return row[0];
+  }
+  int counts[BLOCK_COUNT] = {0};
+  for (int y = y0; y < y0 + s; y++)
+  {
+    for (int z = z0; z < z0 + s; z++)
+    {
+      read_row(area, x0, y, z, s, row);
+      for (int i = 0; i < s; i++)
+      {
+        counts[row[i]]++;
+      }
+    }
+  }
+  int total = s * s * s;
+  if ((total - counts[BLOCK_AIR]) * 2 < total)
+  {
+    return BLOCK_AIR;
+  }
+  BlockType best = BLOCK_AIR;
+  for (int t = BLOCK_AIR + 1; t < BLOCK_COUNT; t++)
+  {
+    if (best == BLOCK_AIR || counts[t] > counts[best])
+    {
+      best = (BlockType)t;
+    }
+  }
+  if (best == BLOCK_DIRT && counts[BLOCK_GRASS] > 0)
+  {
+    best = BLOCK_GRASS;
+  }
+  return best;
+}
+
+// Flood fills the non-opaque blocks of one section and records, for every
+// face, which other faces share an air pocket with it.
+static void section_links(const BlockType *blocks, u8 links[6])
+{
+  enum
+  {
+    N = SECTION_SIZE,
+    VOLUME = N * N * N
+  };
+  bool open[VOLUME];
+  bool seen[VOLUME];
+  u16 queue[VOLUME];
+  int open_count = 0;
+  for (int i = 0; i < VOLUME; i++)
+  {
+    open[i] = !blocks || !block_is_opaque(blocks[i]);
+    open_count += open[i];
+  }
+  memset(links, open_count == VOLUME ? 0x3F : 0, 6);
+  if (open_count == 0 || open_count == VOLUME)
+  {
+    return;
+  }
+
+  memset(seen, 0, sizeof(seen));
+  for (int start = 0; start < VOLUME; start++)
+  {
+    if (!open[start] || seen[start])
+    {
+      continue;
+    }
+    u8 touched = 0;
+    int head = 0, tail = 0;
+    queue[tail++] = (u16)start;
+    seen[start] = true;
+    while (head < tail)
+    {
+      int i = queue[head++];
+      int lx = section_index_x(i), ly = section_index_y(i), lz = section_index_z(i);
+      touched |= (u8)((ly == 0) << FACE_TOP | (ly == N - 1) << FACE_BOTTOM |
+                      (lz == N - 1) << FACE_FRONT | (lz == 0) << FACE_BACK |
+                      (lx == 0) << FACE_LEFT | (lx == N - 1) << FACE_RIGHT);
+      const int next[6] = {
+          ly > 0 ? section_index_dec(i, SECTION_Y_BITS) : -1,
+          ly < N - 1 ? section_index_inc(i, SECTION_Y_BITS) : -1,
+          lz < N - 1 ? section_index_inc(i, SECTION_Z_BITS) : -1,
+          lz > 0 ? section_index_dec(i, SECTION_Z_BITS) : -1,
+          lx > 0 ? section_index_dec(i, SECTION_X_BITS) : -1,
+          lx < N - 1 ? section_index_inc(i, SECTION_X_BITS) : -1};
+      for (int d = 0; d < 6; d++)
+      {
+        if (next[d] >= 0 && open[next[d]] && !seen[next[d]])
+        {
+          seen[next[d]] = true;
+          queue[tail++] = (u16)next[d];
+        }
+      }
+    }
+    for (int face = 0; face < 6; face++)
+    {
+      if (touched & (1 << face))
+      {
+        links[face] |= touched;
+      }
+    }
+  }
+}
+
+// Gives a mesh's faces back to the pool. The section links stay, so the cull
+// search still walks through the chunk.
+static void chunk_mesh_drop_faces(Mc *mc, Chunk *chunk)
+{
+  ChunkMesh *mesh = &chunk->mesh;
+  chunk_mesh_clear(&mc->mesh_pool, mesh);
+  for (int i = 0; i < mesh->section_count; i++)
+  {
+    memset(mesh->sections[i].group_start, 0, sizeof(mesh->sections[i].group_start));
+  }
+  lru_remove(mc, chunk, LRU_MESH);
+  chunk->stage = CHUNK_STAGE_HEIGHTMAP;
+}
+
+// Rebuilds the chunk's mesh. The mesh only counts as clean and the chunk as
+// meshed once every face is in; if memory runs out the mesh stays dirty, so
+// it is tried again on a later call.
+static bool mesh_chunk_build(Mc *mc, Chunk *chunk, int lod, u8 skirt_mask,
+                             const MeshScratch *scratch)
+{
+  MeshPool *pool = &mc->mesh_pool;
+  ChunkMesh *mesh = &chunk->mesh;
+  chunk_mesh_drop_faces(mc, chunk);
+  if (!chunk_reload(mc, chunk))
+  {
+    return false;
+  }
+  mesh->seen_ticks = mc->world_ticks;
+  mesh->lod = lod;
+  mesh->skirt_mask = skirt_mask;
+
+  const int sec_min = chunk->section_min;
+  const int sec_count = chunk->section_count;
+  if (sec_count > mesh->section_count)
+  {
+    SectionMesh *sections =
+        realloc(mesh->sections, (size_t)sec_count * sizeof(SectionMesh));
+    if (!sections)
+    {
+      return false;
+    }
+    mesh->sections = sections;
+  }
+  mesh->section_min = sec_min;
+  mesh->section_count = sec_count;
+  if (sec_count == 0)
+  {
+    mesh->dirty = false;
+    chunk->stage = CHUNK_STAGE_MESHED;
+    return true;
+  }
+  memset(mesh->sections, 0, (size_t)sec_count * sizeof(SectionMesh));
+
+  // Cell grid of one section at this LOD with a one-cell halo on every side.
+  // Cells never straddle a section because the cell size divides it.
+  const int s = 1 << lod;
+  const int n = CHUNK_SIZE / s;
+  const int per_section = SECTION_SIZE / s;
+  const int gx = n + 2;
+  const int gy = per_section + 2;
+  BlockType *grid = scratch->grid;
+  const size_t row_count = (size_t)gy * (size_t)gx;
+  u32 *opaque = scratch->opaque;
+  // Blocks are read straight from the chunk and its neighbours; only the
+  // chunk itself is unpacked, for the flood fill.
+  MeshArea area = {chunk->cx, chunk->cz, {NULL}};
+  bool loaded = true;
+  for (int i = 0; i < 9; i++)
+  {
+    Chunk *n =
+        chunk_map_get(&mc->chunks, chunk->cx + i % 3 - 1, chunk->cz + i / 3 - 1);
+    if (n)
+    {
+      loaded &= chunk_reload(mc, n);
+      chunk_touch(mc, n);
+    }
+    area.chunks[i] = n;
+  }
+  if (!loaded || !chunk_unpack(chunk))
+  {
+    return false;
+  }
+  u32 *drawn = opaque + row_count;
+  u32 *blended = drawn + row_count;
+#define CELL(ix, iy, iz) grid[(((iy) + 1) * gx + ((iz) + 1)) * gx + ((ix) + 1)]
+#define ROW(rows, iy, iz) (rows)[((iy) + 1) * gx + ((iz) + 1)]
+
+  const int bx0 = chunk->cx * CHUNK_SIZE;
+  const int bz0 = chunk->cz * CHUNK_SIZE;
+  // Faces are emitted grouped by direction so the renderer can skip whole
+  // groups that face away from the camera; transparent faces go last.
+  // Skirt borders indexed like chunk_skirt_mask bits: -x, +x, -z, +z
+  static const FaceDir skirt_dir[4] = {FACE_LEFT, FACE_RIGHT, FACE_BACK,
+                                       FACE_FRONT};
+  const u32 interior = ((1u << n) - 1u) << 1;
+  bool complete = true; // every face found room in the pool
+  for (int sec = 0; sec < sec_count; sec++)
+  {
+    SectionMesh *section = &mesh->sections[sec];
+    const BlockType *blocks = chunk->sections[sec].blocks;
+    section_links(blocks, section->links);
+    if (!blocks)
+    {
+      for (int group = 0; group <= MESH_GROUPS; group++)
+      {
+        section->group_start[group] = mesh->face_count;
+      }
+      continue;
+    }
+
+    const int cy0 = (sec_min + sec) * per_section;
+    for (int iy = -1; iy <= per_section; iy++)
+    {
+      for (int iz = -1; iz <= n; iz++)
+      {
+        if (s == 1)
+        {
+          read_row(&area, bx0 - 1, cy0 + iy, bz0 + iz, gx, &CELL(-1, iy, iz));
+        }
+        else
+        {
+          for (int ix = -1; ix <= n; ix++)
+          {
+            CELL(ix, iy, iz) = downsample_cell(&area, bx0 + ix * s, (cy0 + iy) * s,
+                                               bz0 + iz * s, s);
+          }
+        }
+        u32 o = 0, d = 0, b = 0;
+        for (int ix = -1; ix <= n; ix++)
+        {
+          const BlockInfo *info = &block_info[CELL(ix, iy, iz)];
+          u32 bit = 1u << (ix + 1);
+          u32 visible = info->opacity != BLOCK_EMPTY ? bit : 0;
+          o |= info->opacity == BLOCK_OPAQUE ? bit : 0;
+          d |= info->alpha == BLOCK_ALPHA_NONE ? visible : 0;
+          b |= info->alpha == BLOCK_ALPHA_BLEND ? visible : 0;
+        }
+        ROW(opaque, iy, iz) = o;
+        ROW(drawn, iy, iz) = d;
+        ROW(blended, iy, iz) = b;
+      }
+    }
+
+    for (int group = 0; group < MESH_GROUPS; group++)
+    {
+      section->group_start[group] = mesh->face_count;
+      bool transparent_group = (group == MESH_GROUP_TRANSPARENT);
+      int dir_first = transparent_group ? 0 : group;
+      int dir_last = transparent_group ? 5 : group;
+      const u32 *rows = transparent_group ? blended : drawn;
+      for (int iy = 0; iy < per_section; iy++)
+      {
+        for (int iz = 0; iz < n; iz++)
+        {
+          const u32 cells = ROW(rows, iy, iz) & interior;
+          if (!cells)
+          {
+            continue;
+          }
+          const u32 row = ROW(opaque, iy, iz);
+          const u32 exposed[6] = {
+              cells & ~ROW(opaque, iy - 1, iz), cells & ~ROW(opaque, iy + 1, iz),
+              cells & ~ROW(opaque, iy, iz + 1), cells & ~ROW(opaque, iy, iz - 1),
+              cells & ~(row << 1),              cells & ~(row >> 1)};
+
+          // Skirts hang below surface cells on borders shared with another
+          // LOD; they belong to the direction group they face.
+          u32 skirts = 0;
+          for (int b = 0; b < 4 && !transparent_group; b++)
+          {
+            if (!(skirt_mask & (1 << b)) || (int)skirt_dir[b] != group)
+            {
+              continue;
+            }
+            u32 border = (b == 0) ? 1u << 1 : (b == 1) ? 1u << n : 0;
+            if ((b == 2 && iz == 0) || (b == 3 && iz == n - 1))
+            {
+              border = interior;
+            }
+            skirts |= exposed[FACE_TOP] & border;
+          }
+
+          u32 any = skirts;
+          for (int dir = dir_first; dir <= dir_last; dir++)
+          {
+            any |= exposed[dir];
+          }
+          while (any)
+          {
+            int bit = __builtin_ctz(any);
+            any &= any - 1;
+            int ix = bit - 1;
+            const u8 *tex_ids = block_info[CELL(ix, iy, iz)].tex;
+            Texture *top_tex = &mc->block_tex[tex_ids[BLOCK_FACE_TOP]];
+            Texture *side_tex = &mc->block_tex[tex_ids[BLOCK_FACE_SIDE]];
+            Texture *bottom_tex = &mc->block_tex[tex_ids[BLOCK_FACE_BOTTOM]];
+
+            int x = bx0 + ix * s;
+            int y = (cy0 + iy) * s;
+            int z = bz0 + iz * s;
+            float x0 = (float)x, x1 = x0 + (float)s;
+            float y0 = -(float)(y + s), y1 = -(float)y;
+            float z0 = (float)z, z1 = z0 + (float)s;
+
+            for (int dir = dir_first; dir <= dir_last; dir++)
+            {
+              if (!(exposed[dir] & (1u << bit)))
+              {
+                continue;
+              }
+              Texture *tex = (dir == FACE_TOP)      ? top_tex
+                             : (dir == FACE_BOTTOM) ? bottom_tex
+                                                    : side_tex;
+              complete &=
+                  add_box_face(pool, mesh, tex, (FaceDir)dir, x0, x1, y0, y1, z0, z1);
+            }
+            if (skirts & (1u << bit))
+            {
+              complete &= add_box_face(pool, mesh, side_tex, (FaceDir)group, x0, x1,
+                                       y0 - (float)SKIRT_DEPTH, y1, z0, z1);
+            }
+          }
+        }
+      }
+    }
+    section->group_start[MESH_GROUPS] = mesh->face_count;
+  }
+#undef ROW
+#undef CELL
+  chunk_account(mc, chunk); // unpacked, and the mesh tables may have grown
+  voxel_budget_hold(mc, true);
+  if (mesh->page_count > 0)
+  {
+    lru_push_front(mc, chunk, LRU_MESH);
+  }
+  if (!complete)
+  {
+    return false;
+  }
+  mesh->dirty = false;
+  chunk->stage = CHUNK_STAGE_MESHED;
+  return true;
+}
+
+// Drops a mesh's faces; the cull search notices when the chunk comes back
+// into view.
+static void chunk_mesh_evict(Mc *mc, Chunk *chunk)
+{
+  chunk_mesh_drop_faces(mc, chunk);
+  chunk->mesh.dirty = true;
+  chunk->mesh.evicted = true;
+  mc->residency.mesh_evicted++;
+}
+
+// Evicts one mesh to make room in the full pool for chunk's: the least
+// recently seen if it has not been seen for MESH_KEEP_MS, else the visible
+// one farthest from the camera, as long as that is farther than chunk.
+// False if there is none.
+static bool mesh_evict_for(Mc *mc, const Chunk *chunk)
+{
+  Chunk *tail = mc->residency.lru[LRU_MESH].tail;
+  if (tail && tail != chunk && mc->world_ticks - tail->mesh.seen_ticks > MESH_KEEP_MS)
+  {
+    chunk_mesh_evict(mc, tail);
+    return true;
+  }
+  for (int d = mc->render_distance_chunks;
+       d > chunk_distance(mc, chunk->cx, chunk->cz); d--)
+  {
+    for (int dz = -d; dz <= d; dz++)
+    {
+      int step = (abs(dz) == d) ? 1 : 2 * d;
+      for (int dx = -d; dx <= d; dx += step)
+      {
+        Chunk *n = chunk_map_get(&mc->chunks, mc->chunk_cx + dx, mc->chunk_cz + dz);
+        if (n && n->lru[LRU_MESH].linked)
+        {
+          chunk_mesh_evict(mc, n);
+          return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+
+// Meshes the chunk within the mesh budget: while the pool is full, meshes
+// that matter less make way. One that still does not fit is evicted itself,
+// for chunk_mesh_seen to bring back once there is room; the far terrain
+// stands in meanwhile.
+static bool mesh_chunk(Mc *mc, Chunk *chunk, int lod, u8 skirt_mask,
+                       const MeshScratch *scratch)
+{
+  mc->mesh_pool.byte_limit = mc->residency.mesh_budget;
+  while (!mesh_chunk_build(mc, chunk, lod, skirt_mask, scratch))
+  {
+    if (!mesh_pool_full(&mc->mesh_pool))
+    {
+      return false;
+    }
+    if (!mesh_evict_for(mc, chunk))
+    {
+      chunk_mesh_evict(mc, chunk);
+      return false;
+    }
+  }
+  return true;
+}
+
+static void chunk_free(Mc *mc, Chunk *chunk)
+{
+  for (int list = 0; list < LRU_LISTS; list++)
+  {
+    lru_remove(mc, chunk, list);
+  }
+  mc->residency.voxel_bytes -= chunk->voxel_bytes;
+  if (chunk->spill_cap > 0)
+  {
+    spill_slot_release(&mc->residency, chunk->spill_offset, chunk->spill_cap);
+  }
+  chunk_mesh_clear(&mc->mesh_pool, &chunk->mesh);
+  free(chunk->mesh.pages);
+  free(chunk->mesh.sections);
+  chunk_sections_free(chunk);
+  free(chunk);
+}
+
+// Makes a parked or freshly generated chunk resident.
+static void chunk_insert(Mc *mc, Chunk *chunk)
+{
+  chunk->mesh.dirty = true;
+  chunk->mesh.queued = false; // may have been queued before it was parked
+  if (!chunk_map_put(&mc->chunks, chunk))
+  {
+    chunk_free(mc, chunk);
+    return;
+  }
+  chunk_touch(mc, chunk);
+  chunk_account(mc, chunk);
+  voxel_budget_hold(mc, true);
+  world_include_chunk(mc, chunk);
+  // A chunk is only meshed once all eight around it are resident, so the
+  // neighbours are queued in case this one was the last they waited for.
+  // Generation never writes outside the chunk, so nothing else changes.
+  for (int dz = -1; dz <= 1; dz++)
+  {
+    for (int dx = -1; dx <= 1; dx++)
+    {
+      mesh_queue_push(mc, chunk->cx + dx, chunk->cz + dz);
+    }
+  }
+}
+
+static Chunk *chunk_new(int cx, int cz)
+{
+  Chunk *chunk = calloc(1, sizeof(Chunk));
+  if (chunk)
+  {
+    chunk->cx = cx;
+    chunk->cz = cz;
+    for (int i = 0; i < CHUNK_SIZE * CHUNK_SIZE; i++)
+    {
+      chunk->top_solid[i] = COLUMN_EMPTY;
+      chunk->top_opaque[i] = COLUMN_EMPTY;
+    }
+  }
+  return chunk;
+}
+
+// Makes every chunk under box resident: unloaded ones are reloaded, parked
+// ones brought back and missing ones generated on the spot, taking their
+// jobs back from the generator threads if no worker has started them yet.
+// False if a worker is busy with one of them or memory ran out. Chunks past
+// the load distance are dropped, or parked if edited, by the next
+// world_stream.
+bool region_load(Mc *mc, BlockBox box)
+{
+  bool reclaimed = false;
+  for (int cz = floor_div(box.z0, CHUNK_SIZE); cz <= floor_div(box.z1, CHUNK_SIZE);
+       cz++)
+  {
+    for (int cx = floor_div(box.x0, CHUNK_SIZE);
+         cx <= floor_div(box.x1, CHUNK_SIZE); cx++)
+    {
+      Chunk *chunk = chunk_map_get(&mc->chunks, cx, cz);
+      if (chunk)
+      {
+        if (!chunk_reload(mc, chunk))
+        {
+          return false;
+        }
+        continue;
+      }
+      if (!reclaimed && chunk_map_get(&mc->generating, cx, cz))
+      {
+        // world_stream asks for the others again
+        Chunk *queued[GEN_QUEUE_SIZE];
+        int n = gen_pool_reclaim(&mc->gen_pool, queued, GEN_QUEUE_SIZE);
+        for (int i = 0; i < n; i++)
+        {
+          chunk_map_remove(&mc->generating, queued[i]->cx, queued[i]->cz);
+          chunk_free(mc, queued[i]);
+        }
+        reclaimed = true;
+      }
+      if (chunk_map_get(&mc->generating, cx, cz))
+      {
+        return false;
+      }
+      chunk = chunk_map_remove(&mc->parked, cx, cz);
+      if (!chunk)
+      {
+        chunk = chunk_new(cx, cz);
+        if (!chunk)
+        {
+          return false;
+        }
+        if (!worldgen_advance(chunk, CHUNK_STAGE_HEIGHTMAP))
+        {
+          chunk_free(mc, chunk);
+          return false;
+        }
+      }
+      chunk_insert(mc, chunk);
+      chunk = chunk_map_get(&mc->chunks, cx, cz);
+      if (!chunk || !chunk_reload(mc, chunk))
+      {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Stage the eight neighbours must have reached before a chunk can enter each
+// stage, or CHUNK_STAGE_NONE where the chunk itself is all that is read.
+// Meshing looks one block into every neighbour for face culling. Decorating
+// is not gated: trees come from the surface noise of the border columns, not
+// from the neighbours' terrain. Gating it would keep the outermost loaded
+// ring undecorated, and so unmeshable one ring further in, for no change in
+// the blocks. A stage that reads neighbour blocks, such as a light pass,
+// would need its entry here and a load distance one ring wider.
+static const u8 stage_needs[CHUNK_STAGES] = {
+    [CHUNK_STAGE_MESHED] = CHUNK_STAGE_HEIGHTMAP,
+};
+
+// Whether the chunk can advance into stage now
+static bool chunk_stage_ready(Mc *mc, const Chunk *chunk, ChunkStage stage)
+{
+  if (chunk->stage + 1 < (int)stage)
+  {
+    return false;
+  }
+  if (stage_needs[stage] == CHUNK_STAGE_NONE)
+  {
+    return true;
+  }
+  for (int dz = -1; dz <= 1; dz++)
+  {
+    for (int dx = -1; dx <= 1; dx++)
+    {
+      const Chunk *n = chunk_map_get(&mc->chunks, chunk->cx + dx, chunk->cz + dz);
+      if (!n || n->stage < stage_needs[stage])
+      {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+typedef struct
+{
+  int cx;
+  int cz;
+  float priority;
+} ChunkJob;
+
+static int compare_chunk_job(const void *a, const void *b)
+{
+  float pa = ((const ChunkJob *)a)->priority;
+  float pb = ((const ChunkJob *)b)->priority;
+  return (pa > pb) - (pa < pb);
+}
+
+// Keeps the chunks within the load distance of the camera resident. Chunks
+// further out than that (plus one chunk of slack so walking back and forth
+// over a border does not thrash) are dropped, or parked if they were edited.
+// Missing chunks are requested from the generator threads in chunk_priority
+// order, reordered on every call as the camera moves and turns, except the
+// ones around the camera, which are needed right away. Without threads they
+// are generated here, STREAM_CHUNKS_PER_CALL at a time. stream_pending says
+// whether another call is needed.
+void world_stream(Mc *mc)
+{
+  camera_chunk(mc, &mc->chunk_cx, &mc->chunk_cz);
+  const int keep = mc->load_distance_chunks + 1;
+  for (int i = 0; i < mc->chunks.cap; i++)
+  {
+    Chunk *chunk = mc->chunks.slots[i];
+    if (!chunk || chunk_distance(mc, chunk->cx, chunk->cz) <= keep)
+    {
+      continue;
+    }
+    chunk_map_remove(&mc->chunks, chunk->cx, chunk->cz);
+    i--; // backward shift may have moved another chunk into this slot
+    if (chunk->modified)
+    {
+      chunk_mesh_drop_faces(mc, chunk);
+      chunk_pack(chunk);
+      chunk_account(mc, chunk);
+      if (chunk_map_put(&mc->parked, chunk))
+      {
+        continue;
+      }
+    }
+    chunk_free(mc, chunk);
+  }
+
+  // Chunks a worker could not finish keep the stages they did reach and go
+  // back in with the queued ones, to be advanced again from there.
+  Chunk *done[GEN_QUEUE_SIZE];
+  Chunk *unfinished[GEN_QUEUE_SIZE];
+  int unfinished_count = 0;
+  int done_count = gen_pool_collect(&mc->gen_pool, done, GEN_QUEUE_SIZE);
+  for (int i = 0; i < done_count; i++)
+  {
+    chunk_map_remove(&mc->generating, done[i]->cx, done[i]->cz);
+    if (chunk_distance(mc, done[i]->cx, done[i]->cz) > keep)
+    {
+      chunk_free(mc, done[i]);
+      continue;
+    }
+    if (done[i]->stage < CHUNK_STAGE_HEIGHTMAP)
+    {
+      unfinished[unfinished_count++] = done[i];
+      continue;
+    }
+    chunk_insert(mc, done[i]);
+  }
+
+  // Jobs no worker has started come back to be ordered again for where the
+  // camera is now; the ones that left the load distance are cancelled.
+  Chunk *queued[GEN_QUEUE_SIZE];
+  int queued_count = gen_pool_reclaim(&mc->gen_pool, queued, GEN_QUEUE_SIZE);
+  for (int i = 0; i < queued_count; i++)
+  {
+    chunk_map_remove(&mc->generating, queued[i]->cx, queued[i]->cz);
+  }
+  for (int i = 0; i < unfinished_count; i++)
+  {
+    if (queued_count < GEN_QUEUE_SIZE)
+      queued[queued_count++] = unfinished[i];
+    else
+      chunk_free(mc, unfinished[i]);
+  }
+
+  const int l = mc->load_distance_chunks;
+  const int side = 2 * l + 1;
+  // Frame scratch; without it this call asks for nothing and stream_pending
+  // stays set so the next frame tries again
+  ChunkJob *jobs = ARENA_ALLOC(&mc->frame_arena, ChunkJob, side * side);
+  int job_count = 0;
+  mc->stream_pending = true;
+  for (int dz = -l; jobs && dz <= l; dz++)
+  {
+    for (int dx = -l; dx <= l; dx++)
+    {
+      int cx = mc->chunk_cx + dx;
+      int cz = mc->chunk_cz + dz;
+      if (chunk_map_get(&mc->chunks, cx, cz) || chunk_map_get(&mc->generating, cx, cz))
+      {
+        continue;
+      }
+      Chunk *chunk = chunk_map_remove(&mc->parked, cx, cz);
+      if (chunk)
+      {
+        chunk_insert(mc, chunk);
+        continue;
+      }
+      jobs[job_count++] = (ChunkJob){cx, cz, chunk_priority(mc, cx, cz)};
+    }
+  }
+  if (jobs)
+  {
+    qsort(jobs, (size_t)job_count, sizeof(ChunkJob), compare_chunk_job);
+  }
+
+  int budget = STREAM_CHUNKS_PER_CALL;
+  for (int i = 0; i < job_count; i++)
+  {
+    int cx = jobs[i].cx;
+    int cz = jobs[i].cz;
+    bool threaded = mc->gen_pool.thread_count > 0 && chunk_distance(mc, cx, cz) > 1;
+    if (threaded ? mc->generating.count >= GEN_QUEUE_SIZE : budget == 0)
+    {
+      continue;
+    }
+    Chunk *chunk = NULL;
+    for (int k = 0; k < queued_count && !chunk; k++)
+    {
+      if (queued[k]->cx == cx && queued[k]->cz == cz)
+      {
+        chunk = queued[k];
+        queued[k] = queued[--queued_count];
+      }
+    }
+    chunk = chunk ? chunk : chunk_new(cx, cz);
+    if (!chunk)
+    {
+      break;
+    }
+    if (!threaded)
+    {
+      // Out of memory: dropped, and asked for again on a later call
+      if (!worldgen_advance(chunk, CHUNK_STAGE_HEIGHTMAP))
+      {
+        chunk_free(mc, chunk);
+        break;
+      }
+      chunk_insert(mc, chunk);
+      budget--;
+    }
+    else if (!chunk_map_put(&mc->generating, chunk) ||
+             !gen_pool_submit(&mc->gen_pool, chunk, jobs[i].priority))
+    {
+      chunk_map_remove(&mc->generating, cx, cz);
+      chunk_free(mc, chunk);
+      break;
+    }
+  }
+  for (int i = 0; i < queued_count; i++)
+  {
+    chunk_free(mc, queued[i]);
+  }
+  mc->stream_pending = !jobs || job_count > 0 || mc->generating.count > 0;
+}
+
+// Packs the blocks of resident chunks that nothing has used for
+// CHUNK_COLD_MS, looking at a few map slots per call. The chunks around the
+// camera stay unpacked for collisions and raycasts.
+void world_pack_cold(Mc *mc)
+{
+  const Uint32 now = mc->world_ticks;
+  for (int n = 0; n < PACK_SLOTS_PER_CALL && n < mc->chunks.cap; n++)
+  {
+    mc->pack_cursor = (mc->pack_cursor + 1) & (mc->chunks.cap - 1);
+    Chunk *chunk = mc->chunks.slots[mc->pack_cursor];
+    if (chunk && !chunk->packed && !chunk->unloaded &&
+        now - chunk->used_ticks > CHUNK_COLD_MS &&
+        chunk_distance(mc, chunk->cx, chunk->cz) > 1)
+    {
+      chunk_pack(chunk);
+      chunk_account(mc, chunk);
+    }
+  }
+}
+
+// Called by the cull search for every chunk it reaches: keeps the mesh at
+// the front of the mesh LRU list and brings an evicted one back.
+void chunk_mesh_seen(Mc *mc, int cx, int cz)
+{
+  Chunk *chunk = chunk_map_get(&mc->chunks, cx, cz);
+  if (!chunk)
+  {
+    return;
+  }
+  chunk->mesh.seen_ticks = mc->world_ticks;
+  if (chunk->lru[LRU_MESH].linked)
+  {
+    lru_push_front(mc, chunk, LRU_MESH);
+  }
+  // Only rebuilt with an eighth of the budget to spare, so a mesh evicted in
+  // view does not come straight back and push the next one out
+  const Residency *res = &mc->residency;
+  if (chunk->mesh.evicted &&
+      (!res->mesh_budget ||
+       mesh_pool_used_bytes(&mc->mesh_pool) < res->mesh_budget - res->mesh_budget / 8))
+  {
+    chunk->mesh.evicted = false;
+    mc->residency.mesh_reloaded++;
+    mesh_queue_push(mc, cx, cz);
+  }
+}
+
+// Holds block data and meshes to their budgets once a frame, dropping from
+// the least recently used end of each LRU list; reloads and new meshes hold
+// them as they go, this catches what the frame itself used. A chunk's
+// blocks are packed first and dropped if that was not enough; edited ones go
+// to the spill file, the rest are regenerated on use. Meshes count by the
+// slabs the pool holds, which are freed as they empty. Those not seen for
+// MESH_KEEP_MS go first; if that is not enough, visible ones go too,
+// farthest first, and the far terrain stands in for them.
+void world_enforce_budget(Mc *mc)
+{
+  Residency *res = &mc->residency;
+  voxel_budget_hold(mc, false);
+
+  MeshPool *pool = &mc->mesh_pool;
+  pool->byte_limit = res->mesh_budget;
+  mesh_pool_trim(pool);
+  res->mesh_bytes = mesh_pool_reserved_bytes(pool);
+  Chunk *chunk = res->lru[LRU_MESH].tail;
+  while (res->mesh_budget && res->mesh_bytes > res->mesh_budget && chunk)
+  {
+    Chunk *prev = chunk->lru[LRU_MESH].prev;
+    if (mc->world_ticks - chunk->mesh.seen_ticks > MESH_KEEP_MS)
+    {
+      chunk_mesh_evict(mc, chunk);
+      mesh_pool_trim(pool);
+      res->mesh_bytes = mesh_pool_reserved_bytes(pool);
+    }
+    chunk = prev;
+  }
+  for (int d = mc->render_distance_chunks;
+       d >= 0 && res->mesh_budget && res->mesh_bytes > res->mesh_budget; d--)
+  {
+    // The ring of chunks d away from the camera chunk
+    for (int dz = -d; dz <= d && res->mesh_bytes > res->mesh_budget; dz++)
+    {
+      int step = (d == 0 || abs(dz) == d) ? 1 : 2 * d;
+      for (int dx = -d; dx <= d && res->mesh_bytes > res->mesh_budget; dx += step)
+      {
+        chunk = chunk_map_get(&mc->chunks, mc->chunk_cx + dx, mc->chunk_cz + dz);
+        if (chunk && chunk->lru[LRU_MESH].linked)
+        {
+          chunk_mesh_evict(mc, chunk);
+          mesh_pool_trim(pool);
+          res->mesh_bytes = mesh_pool_reserved_bytes(pool);
+        }
+      }
+    }
+  }
+}
+
+// Meshes the queued chunks in the render distance, most urgent first by
+// chunk_priority and chunks without a mesh before LOD changes. When the
+// camera has entered another chunk, meshes that left the render distance are
+// released and every chunk in it is queued again first. With budget_ms above
+// zero it stops once that much time has gone by and leaves the rest queued
+// with mesh_dirty set; the far terrain stands in for them meanwhile.
+void rebuild_faces(Mc *mc, float budget_ms)
+{
+  const Uint64 start = SDL_GetPerformanceCounter();
+  const Uint64 budget =
+      (Uint64)((double)budget_ms * 1e-3 * (double)SDL_GetPerformanceFrequency());
+  camera_chunk(mc, &mc->chunk_cx, &mc->chunk_cz);
+  int r = mc->render_distance_chunks;
+  MeshQueue *q = &mc->mesh_queue;
+
+  if (!q->scanned || q->scan_cx != mc->chunk_cx || q->scan_cz != mc->chunk_cz ||
+      q->scan_render_distance != r ||
+      memcmp(q->scan_lod_distance, mc->lod_distance_chunks,
+             sizeof(q->scan_lod_distance)) != 0)
+  {
+    q->scanned = true;
+    q->scan_cx = mc->chunk_cx;
+    q->scan_cz = mc->chunk_cz;
+    q->scan_render_distance = r;
+    memcpy(q->scan_lod_distance, mc->lod_distance_chunks,
+           sizeof(q->scan_lod_distance));
+    // Chunks that left the render distance give their pages back to the pool
+    for (int i = 0; i < mc->chunks.cap; i++)
+    {
+      Chunk *chunk = mc->chunks.slots[i];
+      if (chunk && chunk->stage == CHUNK_STAGE_MESHED &&
+          chunk_distance(mc, chunk->cx, chunk->cz) > r)
+      {
+        chunk_mesh_drop_faces(mc, chunk);
+        chunk->mesh.dirty = true;
+      }
+    }
+    for (int cz = mc->chunk_cz - r; cz <= mc->chunk_cz + r; cz++)
+    {
+      for (int cx = mc->chunk_cx - r; cx <= mc->chunk_cx + r; cx++)
+      {
+        mesh_queue_push(mc, cx, cz);
+      }
+    }
+  }
+
+  // Frame scratch; without it nothing is meshed and the queue is left for
+  // the next call
+  ChunkJob *jobs = ARENA_ALLOC(&mc->frame_arena, ChunkJob, q->count + 1);
+  MeshScratch scratch = {ARENA_ALLOC(&mc->frame_arena, BlockType, MESH_GRID_CELLS),
+                         ARENA_ALLOC(&mc->frame_arena, u32, 3 * MESH_GRID_ROWS)};
+  if (!jobs || !scratch.grid || !scratch.opaque)
+  {
+    return;
+  }
+  int job_count = 0;
+  for (int i = 0; i < q->count; i++)
+  {
+    int cx = q->chunks[i].cx;
+    int cz = q->chunks[i].cz;
+    Chunk *chunk = chunk_map_get(&mc->chunks, cx, cz);
+    // A chunk parked and brought back can be listed twice
+    if (!chunk || !chunk->mesh.queued)
+    {
+      continue;
+    }
+    chunk->mesh.queued = false;
+    const ChunkMesh *mesh = &chunk->mesh;
+    int lod = chunk_lod(mc, cx, cz);
+    // The rest leave the queue until something changes for them: the camera
+    // moving, the cull search seeing an evicted mesh, a neighbour arriving
+    if (chunk_distance(mc, cx, cz) <= r && !mesh->evicted &&
+        (mesh->dirty || mesh->lod != lod ||
+         mesh->skirt_mask != chunk_skirt_mask(mc, cx, cz, lod)) &&
+        chunk_stage_ready(mc, chunk, CHUNK_STAGE_MESHED))
+    {
+      // Chunks with no mesh to draw go before ones that only change LOD
+      float priority = chunk_priority(mc, cx, cz);
+      jobs[job_count++] = (ChunkJob){cx, cz, mesh->dirty ? priority : priority + 1e6f};
+    }
+  }
+  q->count = 0;
+  qsort(jobs, (size_t)job_count, sizeof(ChunkJob), compare_chunk_job);
+
+  int done = 0;
+  while (done < job_count &&
+         (budget_ms <= 0.0f || SDL_GetPerformanceCounter() - start < budget))
+  {
+    Chunk *chunk = chunk_map_get(&mc->chunks, jobs[done].cx, jobs[done].cz);
+    int lod = chunk_lod(mc, chunk->cx, chunk->cz);
+    if (!mesh_chunk(mc, chunk, lod, chunk_skirt_mask(mc, chunk->cx, chunk->cz, lod),
+                    &scratch))
+    {
+      mesh_queue_push(mc, chunk->cx, chunk->cz); // tried again next call
+    }
+    done++;
+  }
+  for (; done < job_count; done++)
+  {
+    mesh_queue_push(mc, jobs[done].cx, jobs[done].cz);
+  }
+  mc->mesh_dirty = q->count > 0 || !q->scanned;
+}
+
+// A direction group can only contain front faces if the eye is on the front
+// side of at least one of its planes, i.e. of the section's bounds.
+bool section_group_faces_eye(int cx, int sy, int cz, int group, v3f eye)
+{
+  float x_min = (float)(cx * CHUNK_SIZE);
+  float z_min = (float)(cz * CHUNK_SIZE);
+  float x_max = x_min + (float)CHUNK_SIZE;
+  float z_max = z_min + (float)CHUNK_SIZE;
+  switch (group)
+  {
+  case FACE_TOP:
+    return eye.y > -(float)((sy + 1) * SECTION_SIZE);
+  case FACE_BOTTOM:
+    return eye.y < -(float)(sy * SECTION_SIZE);
+  case FACE_FRONT:
+    return eye.z > z_min;
+  case FACE_BACK:
+    return eye.z < z_max;
+  case FACE_LEFT:
+    return eye.x < x_max;
+  case FACE_RIGHT:
+    return eye.x > x_min;
+  default:
+    return true;
+  }
+}
+
+const SectionMesh *section_mesh_get(Mc *mc, int cx, int sy, int cz)
+{
+  ChunkMesh *mesh = chunk_mesh_get(mc, cx, cz);
+  if (!mesh || sy < mesh->section_min ||
+      sy >= mesh->section_min + mesh->section_count)
+  {
+    return NULL;
+  }
+  return &mesh->sections[sy - mesh->section_min];
+}
+
+static void free_map(Mc *mc, ChunkMap *map)
+{
+  for (int i = 0; i < map->cap; i++)
+  {
+    if (map->slots[i])
+    {
+      chunk_free(mc, map->slots[i]);
+    }
+  }
+  chunk_map_free(map);
+}
+
+void world_free(Mc *mc)
+{
+  // Workers stop first; whatever they had queued or finished is ours again
+  gen_pool_free(&mc->gen_pool);
+  free_map(mc, &mc->generating);
+  free_map(mc, &mc->chunks);
+  free_map(mc, &mc->parked);
+  mesh_pool_free(&mc->mesh_pool);
+  free(mc->mesh_queue.chunks);
+  mc->mesh_queue = (MeshQueue){0};
+  if (mc->residency.spill)
+  {
+    fclose(mc->residency.spill);
+    mc->residency.spill = NULL;
   }
-#undef IS_OPAQUE
-  mc->mesh_dirty = false;
+  free(mc->residency.spill_free);
+  mc->residency.spill_free = NULL;
+  mc->residency.spill_free_count = 0;
+  mc->residency.spill_free_cap = 0;
+  mc->residency.spill_end = 0;
 }
 
 void resolve_collisions(Mc *mc)
@@ -257,25 +2624,17 @@ void resolve_collisions(Mc *mc)
   float pcy = (pmin_y + pmax_y) * 0.5f;
   float pcz = (pmin_z + pmax_z) * 0.5f;
 
-  int ix_min = (int)floorf(pmin_x + (float)mc->size_x * 0.5f);
-  int ix_max = (int)floorf(pmax_x + (float)mc->size_x * 0.5f);
-  int iz_min = (int)floorf(pmin_z + (float)mc->size_z * 0.5f);
-  int iz_max = (int)floorf(pmax_z + (float)mc->size_z * 0.5f);
+  int ix_min = (int)floorf(pmin_x);
+  int ix_max = (int)floorf(pmax_x);
+  int iz_min = (int)floorf(pmin_z);
+  int iz_max = (int)floorf(pmax_z);
   int iy_min = (int)floorf(-pmax_y);
   int iy_max = (int)floorf(-pmin_y);
 
-  if (ix_min < 0)
-    ix_min = 0;
   if (iy_min < mc->y_min)
     iy_min = mc->y_min;
-  if (iz_min < 0)
-    iz_min = 0;
-  if (ix_max >= mc->size_x)
-    ix_max = mc->size_x - 1;
   if (iy_max > mc->y_max)
     iy_max = mc->y_max;
-  if (iz_max >= mc->size_z)
-    iz_max = mc->size_z - 1;
 
   mc->grounded = false;
 
@@ -283,16 +2642,18 @@ void resolve_collisions(Mc *mc)
   {
     for (int z = iz_min; z <= iz_max; z++)
     {
-      for (int y = iy_min; y <= iy_max; y++)
+      // Nothing to hit above the top of the column
+      int top = column_top(mc, x, z, false);
+      for (int y = (top > iy_min) ? top : iy_min; y <= iy_max; y++)
       {
-        if (block_get(mc, x, y, z) == BLOCK_AIR)
+        if (!block_is_solid(block_get(mc, x, y, z)))
         {
           continue;
         }
 
-        float bmin_x = (float)x - (float)mc->size_x * 0.5f;
+        float bmin_x = (float)x;
         float bmax_x = bmin_x + 1.0f;
-        float bmin_z = (float)z - (float)mc->size_z * 0.5f;
+        float bmin_z = (float)z;
         float bmax_z = bmin_z + 1.0f;
         float bmin_y = -(float)(y + 1);
         float bmax_y = -(float)y;
@@ -341,9 +2702,9 @@ void resolve_collisions(Mc *mc)
 bool raycast_block(Mc *mc, v3f origin, v3f dir, float max_dist, int *hx,
                    int *hy, int *hz, v3f *hnormal)
 {
-  float gx = origin.x + (float)mc->size_x * 0.5f;
+  float gx = origin.x;
   float gy = -origin.y;
-  float gz = origin.z + (float)mc->size_z * 0.5f;
+  float gz = origin.z;
 
   float gdx = dir.x;
   float gdy = -dir.y;
@@ -378,10 +2739,9 @@ bool raycast_block(Mc *mc, v3f origin, v3f dir, float max_dist, int *hx,
   float t = 0.0f;
   while (t <= max_dist)
   {
-    if (ix >= 0 && ix < mc->size_x && iy >= mc->y_min && iy <= mc->y_max &&
-        iz >= 0 && iz < mc->size_z)
+    if (iy >= mc->y_min && iy <= mc->y_max)
     {
-      if (block_get(mc, ix, iy, iz) != BLOCK_AIR)
+      if (block_is_solid(block_get(mc, ix, iy, iz)))
       {
         *hx = ix;
         *hy = iy;
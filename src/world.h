@@ -2,10 +2,136 @@
 
 #include "mc.h"
 #include <stdbool.h>
+#include <string.h>
 
-BlockType block_get(const Mc *mc, int x, int y, int z);
+BlockType block_get(Mc *mc, int x, int y, int z);
+int column_top(const Mc *mc, int x, int z, bool opaque);
+BlockType chunk_block_get(const Chunk *chunk, int lx, int y, int lz);
+int chunk_column_top(const Chunk *chunk, int lx, int lz, bool opaque);
+BlockType chunk_column_type(const Chunk *chunk, int lx, int lz);
+void chunk_heightmap_rebuild(Chunk *chunk);
+bool chunk_reload(Mc *mc, Chunk *chunk);
+bool chunk_block_set(Chunk *chunk, int lx, int y, int lz, BlockType t);
+ChunkSection *chunk_section_alloc(Chunk *chunk, int sy);
+void section_blocks_retain(const BlockType *blocks);
+void section_blocks_release(const BlockType *blocks);
+bool chunk_snapshot_take(Mc *mc, BlockBox box, ChunkSnapshot *snap);
+void chunk_snapshot_release(ChunkSnapshot *snap);
+BlockType snapshot_block_get(const ChunkSnapshot *snap, int x, int y, int z);
+bool chunk_stamp(Chunk *chunk, const Structure *s, int lx, int y, int lz,
+                 bool into_air);
 void block_set(Mc *mc, int x, int y, int z, BlockType t);
-void rebuild_faces(Mc *mc);
+int region_fill(Mc *mc, BlockBox box, BlockType t);
+int region_replace(Mc *mc, BlockBox box, BlockType from, BlockType to);
+int region_stamp(Mc *mc, const Structure *s, int x, int y, int z, bool into_air);
+int region_apply(Mc *mc, const BlockEdit *edits, int count);
+bool region_load(Mc *mc, BlockBox box);
+bool edit_batch_set(Mc *mc, EditBatch *batch, int x, int y, int z, BlockType t);
+bool edit_batch_row(Mc *mc, EditBatch *batch, int x, int y, int z, int dx, int dz,
+                    int n, BlockType t);
+int edit_batch_finish(Mc *mc, EditBatch *batch);
+void world_stream(Mc *mc);
+void world_pack_cold(Mc *mc);
+void world_enforce_budget(Mc *mc);
+void rebuild_faces(Mc *mc, float budget_ms);
+void world_free(Mc *mc);
+void camera_chunk(const Mc *mc, int *cx, int *cz);
+ChunkMesh *chunk_mesh_get(Mc *mc, int cx, int cz);
+void chunk_mesh_seen(Mc *mc, int cx, int cz);
+void mesh_queue_push(Mc *mc, int cx, int cz);
+const SectionMesh *section_mesh_get(Mc *mc, int cx, int sy, int cz);
+bool section_group_faces_eye(int cx, int sy, int cz, int group, v3f eye);
 void resolve_collisions(Mc *mc);
 bool raycast_block(Mc *mc, v3f origin, v3f dir, float max_dist, int *hx,
                    int *hy, int *hz, v3f *hnormal);
+
+// Blocks inside a section are y-major (x fastest), or with SECTION_BRICKS
+// defined, grouped into 4x4x4 bricks: the bricks and the blocks in each are
+// both ordered y, z, x, so an index is the bits y3 y2 z3 z2 x3 x2 y1 y0 z1 z0
+// x1 x0 and most neighbours share a cache line. Code that walks a section
+// goes through the helpers below and works with either layout.
+#ifdef SECTION_BRICKS
+#define SECTION_X_BITS 0x0C3
+#define SECTION_Z_BITS 0x30C
+#define SECTION_Y_BITS 0xC30
+
+// Index of a block inside its section; all coordinates are section-local.
+static inline int section_block_index(int lx, int ly, int lz)
+{
+  return ((ly >> 2) << 10) | ((lz >> 2) << 8) | ((lx >> 2) << 6) |
+         ((ly & 3) << 4) | ((lz & 3) << 2) | (lx & 3);
+}
+
+// Section-local coordinates of an index, for walking in storage order
+static inline int section_index_x(int i)
+{
+  return (i & 3) | ((i >> 4) & 12);
+}
+
+static inline int section_index_y(int i)
+{
+  return ((i >> 4) & 3) | ((i >> 8) & 12);
+}
+
+static inline int section_index_z(int i)
+{
+  return ((i >> 2) & 3) | ((i >> 6) & 12);
+}
+
+// Copies count blocks of the x row at (lx, ly, lz) out of a section
+static inline void section_read_row(const BlockType *blocks, int lx, int ly,
+                                    int lz, int count, BlockType *out)
+{
+  for (int i = 0; i < count; i++)
+  {
+    out[i] = blocks[section_block_index(lx + i, ly, lz)];
+  }
+}
+#else
+#define SECTION_X_BITS 0x00F
+#define SECTION_Z_BITS 0x0F0
+#define SECTION_Y_BITS 0xF00
+
+// Index of a block inside its section; all coordinates are section-local.
+static inline int section_block_index(int lx, int ly, int lz)
+{
+  return (ly * CHUNK_SIZE + lz) * CHUNK_SIZE + lx;
+}
+
+// Section-local coordinates of an index, for walking in storage order
+static inline int section_index_x(int i)
+{
+  return i & 15;
+}
+
+static inline int section_index_y(int i)
+{
+  return i >> 8;
+}
+
+static inline int section_index_z(int i)
+{
+  return (i >> 4) & 15;
+}
+
+// Copies count blocks of the x row at (lx, ly, lz) out of a section
+static inline void section_read_row(const BlockType *blocks, int lx, int ly,
+                                    int lz, int count, BlockType *out)
+{
+  memcpy(out, &blocks[section_block_index(lx, ly, lz)],
+         (size_t)count * sizeof(BlockType));
+}
+#endif
+
+// Index of the neighbour one block along the axis owning axis_bits. The
+// carry only ripples through that axis's bits, so this is a few ALU ops in
+// either layout; stepping off the section wraps around.
+static inline int section_index_inc(int i, int axis_bits)
+{
+  return (((i | ~axis_bits) + 1) & axis_bits) | (i & ~axis_bits);
+}
+
+static inline int section_index_dec(int i, int axis_bits)
+{
+  return (((i & axis_bits) - 1) & axis_bits) | (i & ~axis_bits);
+}
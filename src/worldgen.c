@@ -0,0 +1,471 @@
+#include "worldgen.h"
+#include "world.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define TERRAIN_SCALE 0.08f
+#define DIRT_DEPTH 3
+#define STONE_START 12
+#define TREE_CHANCE 0.01f // denser trees
+#define TREE_REACH 2 // canopy radius, trunks this far out still reach the chunk
+#define TREE_PAD (CHUNK_SIZE + 2 * TREE_REACH)
+// Generated terrain always spans these rows, however far builds have grown
+// the world, so a chunk comes out the same whenever it is generated.
+#define TERRAIN_TOP 0
+#define TERRAIN_BOTTOM 31
+#define CAVE_CELL 4 // blocks between cave noise samples, trilinear in between
+#define CAVE_SCALE (1.0f / 20.0f)
+#define CAVE_THRESHOLD 0.62f
+#define CAVE_FLOOR (TERRAIN_BOTTOM - 2) // rows from here down are never carved
+#define CAVE_LX (CHUNK_SIZE / CAVE_CELL + 1)
+#define CAVE_LY ((TERRAIN_BOTTOM + 1) / CAVE_CELL + 1)
+
+static float hash2i(uint32_t x, uint32_t z)
+{
+  // Integer hash, returns [0,1). Coordinates are taken as unsigned so that
+  // callers scaling them wrap instead of overflowing.
+  uint32_t h = x * 374761393u + z * 668265263u;
+  h = (h ^ (h >> 13)) * 1274126177u;
+  h ^= (h >> 16);
+  return (float)h / 4294967295.0f;
+}
+
+static float value_noise(float x, float z)
+{
+  int xi = (int)floorf(x);
+  int zi = (int)floorf(z);
+  float xf = x - (float)xi;
+  float zf = z - (float)zi;
+  float v00 = hash2i(xi, zi);
+  float v10 = hash2i(xi + 1, zi);
+  float v01 = hash2i(xi, zi + 1);
+  float v11 = hash2i(xi + 1, zi + 1);
+  float tx = xf * xf * (3.0f - 2.0f * xf);
+  float tz = zf * zf * (3.0f - 2.0f * zf);
+  float xa = v00 * (1.0f - tx) + v10 * tx;
+  float xb = v01 * (1.0f - tx) + v11 * tx;
+  return xa * (1.0f - tz) + xb * tz;
+}
+
+static float fbm2(float x, float z, int octaves, float lacunarity, float gain)
+{
+  float amp = 1.0f;
+  float freq = 1.0f;
+  float sum = 0.0f;
+  float norm = 0.0f;
+  for (int i = 0; i < octaves; i++)
+  {
+    sum += value_noise(x * freq, z * freq) * amp;
+    norm += amp;
+    amp *= gain;
+    freq *= lacunarity;
+  }
+  return (norm > 0.0f) ? (sum / norm) : 0.0f;
+}
+
+// Four-lane versions of the above using GCC/Clang vector extensions, which
+// map to SSE2 or NEON. Every lane does exactly the operations of the scalar
+// code in the same order, so the results are bit-identical to it.
+typedef float f32x4 __attribute__((vector_size(16)));
+typedef int32_t i32x4 __attribute__((vector_size(16)));
+typedef uint32_t u32x4 __attribute__((vector_size(16)));
+
+static f32x4 hash2i_x4(i32x4 x, i32x4 z)
+{
+  u32x4 h = (u32x4)x * 374761393u + (u32x4)z * 668265263u;
+  h = (h ^ (h >> 13)) * 1274126177u;
+  h ^= (h >> 16);
+  return __builtin_convertvector(h, f32x4) / 4294967295.0f;
+}
+
+static i32x4 floor_x4(f32x4 v)
+{
+  i32x4 t = __builtin_convertvector(v, i32x4); // truncates toward zero
+  return t + (__builtin_convertvector(t, f32x4) > v); // true lanes are -1
+}
+
+static f32x4 value_noise_x4(f32x4 x, f32x4 z)
+{
+  i32x4 xi = floor_x4(x);
+  i32x4 zi = floor_x4(z);
+  f32x4 xf = x - __builtin_convertvector(xi, f32x4);
+  f32x4 zf = z - __builtin_convertvector(zi, f32x4);
+  f32x4 v00 = hash2i_x4(xi, zi);
+  f32x4 v10 = hash2i_x4(xi + 1, zi);
+  f32x4 v01 = hash2i_x4(xi, zi + 1);
+  f32x4 v11 = hash2i_x4(xi + 1, zi + 1);
+  f32x4 tx = xf * xf * (3.0f - 2.0f * xf);
+  f32x4 tz = zf * zf * (3.0f - 2.0f * zf);
+  f32x4 xa = v00 * (1.0f - tx) + v10 * tx;
+  f32x4 xb = v01 * (1.0f - tx) + v11 * tx;
+  return xa * (1.0f - tz) + xb * tz;
+}
+
+static f32x4 fbm2_x4(f32x4 x, f32x4 z, int octaves, float lacunarity,
+                     float gain)
+{
+  float amp = 1.0f;
+  float freq = 1.0f;
+  f32x4 sum = {0.0f, 0.0f, 0.0f, 0.0f};
+  float norm = 0.0f;
+  for (int i = 0; i < octaves; i++)
+  {
+    sum += value_noise_x4(x * freq, z * freq) * amp;
+    norm += amp;
+    amp *= gain;
+    freq *= lacunarity;
+  }
+  return (norm > 0.0f) ? (sum / norm) : (f32x4){0.0f, 0.0f, 0.0f, 0.0f};
+}
+
+static f32x4 hash3i_x4(i32x4 x, i32x4 y, i32x4 z)
+{
+  u32x4 h = (u32x4)x * 374761393u + (u32x4)y * 3266489917u +
+            (u32x4)z * 668265263u;
+  h = (h ^ (h >> 13)) * 1274126177u;
+  h ^= (h >> 16);
+  return __builtin_convertvector(h, f32x4) / 4294967295.0f;
+}
+
+static f32x4 value_noise3_x4(f32x4 x, f32x4 y, f32x4 z)
+{
+  i32x4 xi = floor_x4(x);
+  i32x4 yi = floor_x4(y);
+  i32x4 zi = floor_x4(z);
+  f32x4 xf = x - __builtin_convertvector(xi, f32x4);
+  f32x4 yf = y - __builtin_convertvector(yi, f32x4);
+  f32x4 zf = z - __builtin_convertvector(zi, f32x4);
+  f32x4 tx = xf * xf * (3.0f - 2.0f * xf);
+  f32x4 ty = yf * yf * (3.0f - 2.0f * yf);
+  f32x4 tz = zf * zf * (3.0f - 2.0f * zf);
+  f32x4 c00 = hash3i_x4(xi, yi, zi) * (1.0f - tx) + hash3i_x4(xi + 1, yi, zi) * tx;
+  f32x4 c10 = hash3i_x4(xi, yi + 1, zi) * (1.0f - tx) +
+              hash3i_x4(xi + 1, yi + 1, zi) * tx;
+  f32x4 c01 = hash3i_x4(xi, yi, zi + 1) * (1.0f - tx) +
+              hash3i_x4(xi + 1, yi, zi + 1) * tx;
+  f32x4 c11 = hash3i_x4(xi, yi + 1, zi + 1) * (1.0f - tx) +
+              hash3i_x4(xi + 1, yi + 1, zi + 1) * tx;
+  f32x4 c0 = c00 * (1.0f - ty) + c10 * ty;
+  f32x4 c1 = c01 * (1.0f - ty) + c11 * ty;
+  return c0 * (1.0f - tz) + c1 * tz;
+}
+
+// Two octaves of 3D value noise at cave lattice points, given in lattice
+// units. Cave density everywhere else is interpolated from these.
+static f32x4 cave_lattice_x4(i32x4 lx, i32x4 ly, i32x4 lz)
+{
+  f32x4 x = __builtin_convertvector(lx * CAVE_CELL, f32x4) * CAVE_SCALE;
+  f32x4 y = __builtin_convertvector(ly * CAVE_CELL, f32x4) * CAVE_SCALE;
+  f32x4 z = __builtin_convertvector(lz * CAVE_CELL, f32x4) * CAVE_SCALE;
+  f32x4 n = value_noise3_x4(x, y, z) + value_noise3_x4(x * 2.0f, y * 2.0f, z * 2.0f) * 0.5f;
+  return n / 1.5f;
+}
+
+// Evaluates fbm2 at (x * scale, z * scale) for nx by nz block columns
+// spaced step blocks apart, starting at (x0, z0), row by row into out.
+// Same values as calling fbm2 on each point.
+static void fbm2_grid(int x0, int z0, int nx, int nz, int step, float scale,
+                      int octaves, float lacunarity, float gain, float *out)
+{
+  for (int iz = 0; iz < nz; iz++)
+  {
+    float fz = (float)(z0 + iz * step) * scale;
+    for (int ix = 0; ix < nx; ix += 4)
+    {
+      i32x4 xs = {ix, ix + 1, ix + 2, ix + 3};
+      xs = x0 + xs * step;
+      f32x4 fx = __builtin_convertvector(xs, f32x4) * scale;
+      f32x4 h = fbm2_x4(fx, (f32x4){fz, fz, fz, fz}, octaves, lacunarity, gain);
+      for (int k = 0; k < 4 && ix + k < nx; k++)
+      {
+        out[iz * nx + ix + k] = h[k];
+      }
+    }
+  }
+}
+
+static inline int floor_div(int a, int b)
+{
+  return (a >= 0) ? a / b : -((-a + b - 1) / b);
+}
+
+// Interpolates between the lattice samples at the corners of a y-z cell.
+// Shared by the chunk carver and cave_carved so both agree to the bit.
+static inline float cave_bilerp(float l00, float l10, float l01, float l11,
+                                float fy, float fz)
+{
+  float a = l00 * (1.0f - fy) + l10 * fy;
+  float b = l01 * (1.0f - fy) + l11 * fy;
+  return a * (1.0f - fz) + b * fz;
+}
+
+static bool cave_carves(float density, int y)
+{
+  return density > CAVE_THRESHOLD && y >= TERRAIN_TOP && y < CAVE_FLOOR;
+}
+
+// Whether the cave noise removes the block at (x, y, z), for checks outside
+// the chunk being carved.
+static bool cave_carved(int x, int y, int z)
+{
+  if (y < TERRAIN_TOP || y >= CAVE_FLOOR)
+  {
+    return false;
+  }
+  int gx = floor_div(x, CAVE_CELL);
+  int gy = y / CAVE_CELL;
+  int gz = floor_div(z, CAVE_CELL);
+  f32x4 lo = cave_lattice_x4((i32x4){gx, gx, gx, gx},
+                             (i32x4){gy, gy + 1, gy, gy + 1},
+                             (i32x4){gz, gz, gz + 1, gz + 1});
+  f32x4 hi = cave_lattice_x4((i32x4){gx + 1, gx + 1, gx + 1, gx + 1},
+                             (i32x4){gy, gy + 1, gy, gy + 1},
+                             (i32x4){gz, gz, gz + 1, gz + 1});
+  float fx = (float)(x - gx * CAVE_CELL) * (1.0f / CAVE_CELL);
+  float fy = (float)(y - gy * CAVE_CELL) * (1.0f / CAVE_CELL);
+  float fz = (float)(z - gz * CAVE_CELL) * (1.0f / CAVE_CELL);
+  float e0 = cave_bilerp(lo[0], lo[1], lo[2], lo[3], fy, fz);
+  float e1 = cave_bilerp(hi[0], hi[1], hi[2], hi[3], fy, fz);
+  return cave_carves(e0 * (1.0f - fx) + e1 * fx, y);
+}
+
+// Carves caves and overhangs out of the freshly layered chunk. The noise is
+// sampled every CAVE_CELL blocks, four samples at a time, and interpolated
+// four blocks at a time along x.
+static void carve_caves(Chunk *chunk, int top)
+{
+  float lattice[CAVE_LY][CAVE_LX][CAVE_LX]; // y, z, x
+  const int gx0 = chunk->cx * (CHUNK_SIZE / CAVE_CELL);
+  const int gz0 = chunk->cz * (CHUNK_SIZE / CAVE_CELL);
+  const int points = CAVE_LY * CAVE_LX * CAVE_LX;
+  for (int i = 0; i < points; i += 4)
+  {
+    i32x4 idx = {i, i + 1, i + 2, i + 3};
+    idx = (idx < points) & idx; // lanes past the end sample point 0
+    f32x4 n = cave_lattice_x4(gx0 + idx % CAVE_LX, idx / (CAVE_LX * CAVE_LX),
+                              gz0 + idx / CAVE_LX % CAVE_LX);
+    for (int k = 0; k < 4 && i + k < points; k++)
+    {
+      (&lattice[0][0][0])[i + k] = n[k];
+    }
+  }
+
+  const f32x4 fx = {0.0f, 0.25f, 0.5f, 0.75f};
+  for (int y = top; y < CAVE_FLOOR; y++)
+  {
+    ChunkSection *section = &chunk->sections[y / SECTION_SIZE - chunk->section_min];
+    int gy = y / CAVE_CELL;
+    float fy = (float)(y - gy * CAVE_CELL) * (1.0f / CAVE_CELL);
+    for (int lz = 0; lz < CHUNK_SIZE; lz++)
+    {
+      int gz = lz / CAVE_CELL;
+      float fz = (float)(lz - gz * CAVE_CELL) * (1.0f / CAVE_CELL);
+      float e[CAVE_LX];
+      for (int gx = 0; gx < CAVE_LX; gx++)
+      {
+        e[gx] = cave_bilerp(lattice[gy][gz][gx], lattice[gy + 1][gz][gx],
+                            lattice[gy][gz + 1][gx], lattice[gy + 1][gz + 1][gx],
+                            fy, fz);
+      }
+      for (int gx = 0; gx < CAVE_LX - 1; gx++)
+      {
+        f32x4 density = e[gx] * (1.0f - fx) + e[gx + 1] * fx;
+        for (int k = 0; k < 4; k++)
+        {
+          BlockType *block = &section->blocks[section_block_index(
+              gx * CAVE_CELL + k, y % SECTION_SIZE, lz)];
+          if (cave_carves(density[k], y) && *block != BLOCK_AIR)
+          {
+            *block = BLOCK_AIR;
+            section->solid_count--;
+          }
+        }
+      }
+    }
+  }
+  for (int i = 0; i < chunk->section_count; i++)
+  {
+    if (chunk->sections[i].blocks && chunk->sections[i].solid_count == 0)
+    {
+      section_blocks_release(chunk->sections[i].blocks);
+      chunk->sections[i].blocks = NULL;
+    }
+  }
+}
+
+#define L BLOCK_LEAVES
+#define _ BLOCK_AIR
+// Leaves above a trunk, anchored at the cell right above the trunk top.
+static const BlockType canopy_blocks[4 * 5 * 5] = {
+    _, _, _, _, _,  _, _, _, _, _,  _, _, L, _, _,  _, _, _, _, _,  _, _, _, _, _,
+    _, _, _, _, _,  _, L, L, L, _,  _, L, L, L, _,  _, L, L, L, _,  _, _, _, _, _,
+    _, L, L, L, _,  L, L, L, L, L,  L, L, L, L, L,  L, L, L, L, L,  _, L, L, L, _,
+    _, L, L, L, _,  L, L, L, L, L,  L, L, L, L, L,  L, L, L, L, L,  _, L, L, L, _,
+};
+#undef _
+#undef L
+static const Structure canopy = {5, 4, 5, 2, 3, 2, canopy_blocks};
+
+static const BlockType trunk_blocks[6] = {BLOCK_OAK_LOG, BLOCK_OAK_LOG,
+                                          BLOCK_OAK_LOG, BLOCK_OAK_LOG,
+                                          BLOCK_OAK_LOG, BLOCK_OAK_LOG};
+
+// Trees are decided from the column hash and the generated surface alone,
+// never from blocks already placed, so every chunk a canopy overlaps agrees
+// on where it is. The trunk replaces anything, leaves only fill air, so
+// overlapping trees come out the same whichever is stamped first, and
+// stamping them all again after a failure changes nothing already placed.
+// False if a section could not be allocated.
+static bool scatter_trees(Chunk *chunk, const int ground[][TREE_PAD])
+{
+  const int x0 = chunk->cx * CHUNK_SIZE - TREE_REACH;
+  const int z0 = chunk->cz * CHUNK_SIZE - TREE_REACH;
+  for (int iz = 0; iz < TREE_PAD; iz++)
+  {
+    for (int ix = 0; ix < TREE_PAD; ix++)
+    {
+      int x = x0 + ix, z = z0 + iz;
+      if (hash2i((uint32_t)x * 31u, (uint32_t)z * 17u) >= TREE_CHANCE)
+      {
+        continue;
+      }
+      int y = ground[iz][ix];
+      int trunk_h = // 4-6 tall
+          4 + (int)(hash2i((uint32_t)x * 13u, (uint32_t)z * 29u) * 3.0f);
+      if (y - trunk_h - 2 < TERRAIN_TOP || cave_carved(x, y, z))
+      {
+        continue;
+      }
+      int lx = ix - TREE_REACH, lz = iz - TREE_REACH;
+      Structure trunk = {1, trunk_h, 1, 0, trunk_h - 1, 0, trunk_blocks};
+      if (!chunk_stamp(chunk, &trunk, lx, y - 1, lz, false) ||
+          !chunk_stamp(chunk, &canopy, lx, y - trunk_h - 1, lz, true))
+      {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Row of the grass block over terrain of height h, before caves are carved
+int worldgen_surface(float h)
+{
+  int surface = STONE_START + (int)(h * 8.0f); // 1..9 ish
+  if (surface > TERRAIN_BOTTOM)
+    surface = TERRAIN_BOTTOM;
+  if (surface < 1)
+    surface = 1;
+  return surface;
+}
+
+// Terrain height noise of column (x, z), one point at a time
+float worldgen_height(int x, int z)
+{
+  return fbm2((float)x * TERRAIN_SCALE, (float)z * TERRAIN_SCALE, 4, 2.0f, 0.5f);
+}
+
+// worldgen_height of nx by nz columns spaced step blocks apart, starting at
+// (x0, z0), row by row into out. Four columns at a time, and bit-identical
+// to worldgen_height so both give the same terrain.
+void worldgen_height_grid(int x0, int z0, int nx, int nz, int step, float *out)
+{
+  fbm2_grid(x0, z0, nx, nz, step, TERRAIN_SCALE, 4, 2.0f, 0.5f, out);
+}
+
+// Layers grass, dirt and stone under the surface and carves the caves. False
+// if a section could not be allocated, before any block is written.
+static bool worldgen_terrain(Chunk *chunk, const int ground[][TREE_PAD])
+{
+  int top = TERRAIN_BOTTOM;
+  for (int lz = 0; lz < CHUNK_SIZE; lz++)
+  {
+    for (int lx = 0; lx < CHUNK_SIZE; lx++)
+    {
+      if (ground[lz + TREE_REACH][lx + TREE_REACH] < top)
+        top = ground[lz + TREE_REACH][lx + TREE_REACH];
+    }
+  }
+
+  // Columns are written straight into the section arrays, which are all
+  // allocated up front from the highest surface down.
+  for (int sy = top / SECTION_SIZE; sy <= TERRAIN_BOTTOM / SECTION_SIZE; sy++)
+  {
+    if (!chunk_section_alloc(chunk, sy))
+    {
+      return false;
+    }
+  }
+  for (int lz = 0; lz < CHUNK_SIZE; lz++)
+  {
+    for (int lx = 0; lx < CHUNK_SIZE; lx++)
+    {
+      int grass = ground[lz + TREE_REACH][lx + TREE_REACH];
+      int dirt_end = grass + DIRT_DEPTH;
+      for (int y = grass; y <= TERRAIN_BOTTOM; y++)
+      {
+        ChunkSection *section =
+            &chunk->sections[y / SECTION_SIZE - chunk->section_min];
+        BlockType t = (y == grass)       ? BLOCK_GRASS
+                      : (y <= dirt_end) ? BLOCK_DIRT
+                                        : BLOCK_STONE;
+        section->blocks[section_block_index(lx, y % SECTION_SIZE, lz)] = t;
+        section->solid_count++;
+      }
+    }
+  }
+
+  carve_caves(chunk, top);
+  return true;
+}
+
+// Runs the chunk's generation stages up to target (at most
+// CHUNK_STAGE_HEIGHTMAP). None of them reads outside the chunk, since trees
+// come from the surface noise of the border columns rather than from the
+// neighbours' blocks, so chunks can be generated in any order and on any
+// thread. False if a stage ran out of memory; the chunk is then left at the
+// last stage it finished, and advancing it again retries from there.
+bool worldgen_advance(Chunk *chunk, ChunkStage target)
+{
+  // Surface rows of the chunk and of the border columns trees may stand on,
+  // shared by the terrain and the trees
+  int ground[TREE_PAD][TREE_PAD];
+  if (chunk->stage < CHUNK_STAGE_DECORATED && target > CHUNK_STAGE_NONE)
+  {
+    float height[TREE_PAD][TREE_PAD];
+    worldgen_height_grid(chunk->cx * CHUNK_SIZE - TREE_REACH,
+                         chunk->cz * CHUNK_SIZE - TREE_REACH, TREE_PAD, TREE_PAD, 1,
+                         &height[0][0]);
+    for (int iz = 0; iz < TREE_PAD; iz++)
+    {
+      for (int ix = 0; ix < TREE_PAD; ix++)
+      {
+        ground[iz][ix] = worldgen_surface(height[iz][ix]);
+      }
+    }
+  }
+  for (int stage = chunk->stage + 1;
+       stage <= (int)target && stage <= CHUNK_STAGE_HEIGHTMAP; stage++)
+  {
+    bool done = true;
+    switch (stage)
+    {
+    case CHUNK_STAGE_TERRAIN:
+      done = worldgen_terrain(chunk, ground);
+      break;
+    case CHUNK_STAGE_DECORATED:
+      done = scatter_trees(chunk, ground);
+      break;
+    case CHUNK_STAGE_HEIGHTMAP:
+      chunk_heightmap_rebuild(chunk);
+      break;
+    }
+    if (!done)
+    {
+      return false;
+    }
+    chunk->stage = (u8)stage;
+  }
+  return true;
+}
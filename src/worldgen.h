@@ -0,0 +1,8 @@
+#pragma once
+
+#include "mc.h"
+
+float worldgen_height(int x, int z);
+void worldgen_height_grid(int x0, int z0, int nx, int nz, int step, float *out);
+int worldgen_surface(float height);
+bool worldgen_advance(Chunk *chunk, ChunkStage target);
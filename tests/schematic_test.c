@@ -0,0 +1,211 @@
+// Round trip of the schematic format: a generated region with a few
+// hand-placed blocks is saved, pasted back with every combination of quarter
+// turns and mirroring, and each pasted block is compared with the one it was
+// saved from. Damaged files must be refused, and a background save must not
+// see edits made while it runs.
+#include "mc.h"
+#include "schematic.h"
+#include "world.h"
+#include <stdio.h>
+
+#define W 21
+#define H 48
+#define D 13
+
+static Mc mc;
+static BlockType saved[H][D][W];
+
+// Cell (sx, sz) relative to the anchor, mirrored and turned like a paste
+static void place(int dx, int dz, int turns, bool mirror, int *px, int *pz)
+{
+  if (mirror)
+  {
+    dx = -dx;
+  }
+  for (int i = 0; i < turns; i++)
+  {
+    int t = dx;
+    dx = -dz;
+    dz = t;
+  }
+  *px = dx;
+  *pz = dz;
+}
+
+static bool copy_file(const char *from, const char *to, long size, long flip)
+{
+  FILE *in = fopen(from, "rb");
+  FILE *out = fopen(to, "wb");
+  bool ok = in && out;
+  for (long i = 0; ok && i < size; i++)
+  {
+    int c = fgetc(in);
+    ok = c != EOF && fputc((i == flip) ? c ^ 0xFF : c, out) != EOF;
+  }
+  if (in)
+    fclose(in);
+  if (out && fclose(out) != 0)
+    ok = false;
+  return ok;
+}
+
+int main(int argc, char **argv)
+{
+  const char *path = (argc > 1) ? argv[1] : "schematic_test.schem";
+  char damaged[512];
+  snprintf(damaged, sizeof(damaged), "%s.bad", path);
+
+  const BlockBox src = {-5, 0, 7, -5 + W - 1, H - 1, 7 + D - 1};
+  const int ax = -2, ay = 20, az = 9;
+  if (!region_load(&mc, src))
+  {
+    fprintf(stderr, "schematic: could not generate the source region\n");
+    return 1;
+  }
+  // Blocks no terrain has, so a wrong turn cannot match by chance
+  region_fill(&mc, (BlockBox){-5, 2, 7, -5, 9, 7}, BLOCK_GLASS);
+  region_fill(&mc, (BlockBox){-4, 2, 7, 0, 2, 7}, BLOCK_OAK_PLANKS);
+  region_fill(&mc, (BlockBox){-5, 2, 8, -5, 2, 10}, BLOCK_COBBLESTONE);
+  for (int sy = 0; sy < H; sy++)
+    for (int sz = 0; sz < D; sz++)
+      for (int sx = 0; sx < W; sx++)
+        saved[sy][sz][sx] = block_get(&mc, src.x0 + sx, src.y0 + sy, src.z0 + sz);
+  if (!schematic_save(&mc, path, src, ax, ay, az))
+  {
+    fprintf(stderr, "schematic: save to %s failed\n", path);
+    return 1;
+  }
+
+  int failures = 0;
+  const int py = 20;
+  const int pz = -200;
+  for (int k = 0; k < 8; k++)
+  {
+    int turns = k & 3;
+    bool mirror = k >= 4;
+    // Each paste lands on ground nothing has loaded yet; air cells leave it
+    // as it was, so only the solid ones are checked. Pasting again over a
+    // cleared box checks the air cells too.
+    int px = 300 + k * 80;
+    BlockBox clear = {px - W - D, py - ay, pz - W - D, px + W + D, py - ay + H - 1,
+                      pz + W + D};
+    for (int pass = 0; pass < 2; pass++)
+    {
+      if (pass == 1)
+      {
+        region_fill(&mc, clear, BLOCK_AIR);
+      }
+      if (schematic_paste(&mc, path, px, py, pz, turns, mirror) < 0)
+      {
+        fprintf(stderr, "schematic: paste with %d turns%s failed\n", turns,
+                mirror ? ", mirrored" : "");
+        failures++;
+        break;
+      }
+      long wrong = 0;
+      for (int sy = 0; sy < H; sy++)
+        for (int sz = 0; sz < D; sz++)
+          for (int sx = 0; sx < W; sx++)
+          {
+            int dx, dz;
+            place(src.x0 + sx - ax, src.z0 + sz - az, turns, mirror, &dx, &dz);
+            BlockType want = saved[sy][sz][sx];
+            if (pass == 1 || want != BLOCK_AIR)
+            {
+              wrong += block_get(&mc, px + dx, py - ay + src.y0 + sy, pz + dz) != want;
+            }
+          }
+      if (wrong > 0)
+      {
+        fprintf(stderr, "schematic: %ld blocks wrong with %d turns%s\n", wrong,
+                turns, mirror ? ", mirrored" : "");
+        failures++;
+        break;
+      }
+      // Pasted rows leave the column tops to be rescanned once at the end
+      for (int cz = clear.z0; cz <= clear.z1; cz++)
+        for (int cx = clear.x0; cx <= clear.x1; cx++)
+        {
+          int top = mc.y_min;
+          while (top <= mc.y_max && block_get(&mc, cx, top, cz) == BLOCK_AIR)
+            top++;
+          wrong += column_top(&mc, cx, cz, false) != ((top > mc.y_max) ? COLUMN_EMPTY : top);
+        }
+      if (wrong > 0)
+      {
+        fprintf(stderr, "schematic: %ld column tops wrong with %d turns%s\n", wrong,
+                turns, mirror ? ", mirrored" : "");
+        failures++;
+        break;
+      }
+    }
+  }
+
+  FILE *f = fopen(path, "rb");
+  long size = 0;
+  if (f && fseek(f, 0, SEEK_END) == 0)
+  {
+    size = ftell(f);
+  }
+  if (f)
+  {
+    fclose(f);
+  }
+  // Cut short, then with a corrupt magic
+  if (!copy_file(path, damaged, size - 3, -1) ||
+      schematic_paste(&mc, damaged, 300, py, pz, 0, false) != -1)
+  {
+    fprintf(stderr, "schematic: truncated file was not refused\n");
+    failures++;
+  }
+  if (!copy_file(path, damaged, size, 0) ||
+      schematic_paste(&mc, damaged, 300, py, pz, 0, false) != -1)
+  {
+    fprintf(stderr, "schematic: bad magic was not refused\n");
+    failures++;
+  }
+
+  // A background save keeps the blocks it started with while the box is
+  // overwritten under it
+  SchematicSave save;
+  if (!schematic_save_start(&mc, &save, damaged, src, ax, ay, az))
+  {
+    fprintf(stderr, "schematic: background save to %s failed to start\n", damaged);
+    failures++;
+  }
+  else
+  {
+    region_fill(&mc, src, BLOCK_GLASS);
+    SchematicReader r;
+    long wrong = 0;
+    u32 cell = 0, n;
+    BlockType t;
+    if (!schematic_save_finish(&save) || !schematic_reader_open(&r, damaged))
+    {
+      wrong = 1;
+    }
+    else
+    {
+      while ((n = schematic_reader_run(&r, &t)) > 0)
+      {
+        for (; n > 0; n--, cell++)
+        {
+          wrong += (&saved[0][0][0])[cell] != t;
+        }
+      }
+      wrong += !schematic_reader_close(&r);
+    }
+    if (wrong > 0)
+    {
+      fprintf(stderr, "schematic: background save wrote %ld blocks wrong\n", wrong);
+      failures++;
+    }
+  }
+  remove(damaged);
+  remove(path);
+  world_free(&mc);
+
+  printf("schematic: %d x %d x %d cells, %ld bytes, %s\n", W, H, D, size,
+         failures ? "FAILED" : "ok");
+  return failures ? 1 : 0;
+}